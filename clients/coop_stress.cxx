@@ -0,0 +1,179 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+// Stress test for SharedLake: many players clearing one board at once
+//
+// Usage: coop_stress [-t THREADS] [-r ROWS] [-c COLS] [-m MINES] [-p PROBES]
+//                    [-s SEED]
+//
+// Each thread plays PROBES random probes on patches it has not seen revealed
+// yet, all on the same board, and keeps a record of what it probed.  When all
+// threads are done, the recorded probes are played again by a single thread,
+// in a different order, on a fresh board.  The two boards must end up exactly
+// the same.  Exits with status 1 if they don't.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "sharedlake.hxx"
+
+using namespace std;
+
+
+namespace
+{
+typedef vector<Coords> Probes;
+
+/// Current time in seconds
+double now()
+{
+  return chrono::duration<double>(
+	chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/// One player: probe random unexplored patches, recording each probe made
+void play(SharedLake *board, int probes, uint64_t seed, Probes *record)
+{
+  set<Coords> changes;
+  for (int i = 0; i < probes && board->to_go(); ++i)
+  {
+    // A simple 64-bit LCG is plenty for picking patches
+    seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+    const int row = int((seed >> 33) % board->rows()),
+	      col = int((seed >> 13) % board->cols());
+    if (board->status_at(row, col) != '^') continue;
+    record->push_back(Coords(row, col));
+    changes.clear();
+    try
+    {
+      board->probe(row, col, changes);
+    }
+    catch (const Boom &)
+    {
+    }
+  }
+}
+
+
+void usage(const char name[])
+{
+  fprintf(stderr,
+	"Usage: %s [-t THREADS] [-r ROWS] [-c COLS] [-m MINES] [-p PROBES] "
+	"[-s SEED]\n",
+	name);
+  exit(2);
+}
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+  int threads = thread::hardware_concurrency(),
+      rows = 1000,
+      cols = 1000,
+      mines = -1,
+      probes = 10000;
+  unsigned long seed = 1;
+  for (int opt; (opt = getopt(argc, argv, "t:r:c:m:p:s:")) != -1; )
+  {
+    switch (opt)
+    {
+    case 't': threads = atoi(optarg); break;
+    case 'r': rows = atoi(optarg); break;
+    case 'c': cols = atoi(optarg); break;
+    case 'm': mines = atoi(optarg); break;
+    case 'p': probes = atoi(optarg); break;
+    case 's': seed = strtoul(optarg, 0, 10); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind != argc || rows <= 0 || cols <= 0 || probes < 0) usage(argv[0]);
+  if (threads <= 0) threads = 1;
+  if (mines < 0) mines = int(rows * double(cols) / 8);
+
+  try
+  {
+    SharedLake board(rows, cols, mines, seed);
+    vector<Probes> records(threads);
+    vector<thread> players;
+    const double start = now();
+    for (int t = 0; t < threads; ++t)
+      players.push_back(
+	thread(play, &board, probes, seed*1000003 + t, &records[t]));
+    for (int t = 0; t < threads; ++t) players[t].join();
+    const double elapsed = now() - start;
+
+    // Replay every thread's probes, last thread first and latest probe first
+    SharedLake replay(rows, cols, mines, seed);
+    int made = 0;
+    set<Coords> changes;
+    const double restart = now();
+    for (int t = threads-1; t >= 0; --t)
+      for (Probes::reverse_iterator i = records[t].rbegin();
+	   i != records[t].rend();
+	   ++i)
+      {
+	++made;
+	changes.clear();
+	try
+	{
+	  replay.probe(i->row, i->col, changes);
+	}
+	catch (const Boom &)
+	{
+	}
+      }
+    const double replayed = now() - restart;
+
+    int differences = 0;
+    for (int r = 0; r < rows; ++r) for (int c = 0; c < cols; ++c)
+      differences += (board.status_at(r,c) != replay.status_at(r,c));
+
+    printf("%d threads made %d probes in %.3fs (%.0f probes/s), "
+	"%d moves, %d mines hit, %d patches to go\n",
+	threads, made, elapsed, made/elapsed, board.moves(), board.booms(),
+	board.to_go());
+    printf("Serial replay took %.3fs: %d moves, %d mines hit, "
+	"%d patches to go\n",
+	replayed, replay.moves(), replay.booms(), replay.to_go());
+
+    if (differences ||
+	board.to_go() != replay.to_go() ||
+	board.booms() != replay.booms())
+    {
+      printf("MISMATCH: %d patches differ\n", differences);
+      return 1;
+    }
+    printf("Boards match\n");
+  }
+  catch (const exception &e)
+  {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
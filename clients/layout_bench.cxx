@@ -0,0 +1,168 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+
+// Benchmark comparing the two memory layouts of a Lake's playing field
+//
+// Usage: layout_bench [-r ROWS] [-w WIDTH]... [-d DENSITY] [-p PROBES]
+//                     [-s SEED]
+//
+// For each width (by default a range of them, from narrow to very wide), makes
+// the same game in row_major_layout and in blocked_layout, and times how long
+// it takes to generate, both the normal way and in tiles, and how many patches
+// per second a series of flood-filling probes reveals.  Both layouts must come
+// up with exactly the same game; exits with status 1 if they don't.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gamelogic.hxx"
+
+using namespace std;
+
+
+namespace
+{
+const char *const layout_name[] = { "row-major", "blocked" };
+
+/// Current time in seconds
+double now()
+{
+  return chrono::duration<double>(
+	chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/// Results of one run
+struct Run
+{
+  double generate, tiled, fill;
+  long revealed;
+  uint64_t digest;
+};
+
+
+Run run(int rows, int cols, int mines, int probes, unsigned long seed,
+	Layout layout)
+{
+  Run result;
+  Lake lake(rows, cols, 0, seed, square_topology, layout);
+  double start = now();
+  lake.reset_tiled(rows, cols, mines, seed, 1, layout);
+  result.tiled = now() - start;
+
+  start = now();
+  lake.reset(rows, cols, mines, seed, square_topology, layout);
+  result.generate = now() - start;
+
+  // Probe pseudo-random patches; level-1 intelligence floods the openings
+  set<Coords> changes;
+  result.revealed = 0;
+  start = now();
+  for (int i = 0; i < probes && lake.to_go(); ++i)
+  {
+    seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+    const int row = int((seed >> 33) % rows), col = int((seed >> 13) % cols);
+    changes.clear();
+    try
+    {
+      lake.probe(row, col, changes);
+    }
+    catch (const Boom &)
+    {
+    }
+    result.revealed += changes.size();
+  }
+  result.fill = now() - start;
+  result.digest = lake.digest();
+  return result;
+}
+
+
+void usage(const char name[])
+{
+  fprintf(stderr,
+	"Usage: %s [-r ROWS] [-w WIDTH]... [-d DENSITY] [-p PROBES] "
+	"[-s SEED]\n",
+	name);
+  exit(2);
+}
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+  int rows = 256, probes = 50;
+  double density = 0.05;
+  unsigned long seed = 1;
+  vector<int> widths;
+  for (int opt; (opt = getopt(argc, argv, "r:w:d:p:s:")) != -1; )
+  {
+    switch (opt)
+    {
+    case 'r': rows = atoi(optarg); break;
+    case 'w': widths.push_back(atoi(optarg)); break;
+    case 'd': density = atof(optarg); break;
+    case 'p': probes = atoi(optarg); break;
+    case 's': seed = strtoul(optarg, 0, 10); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind != argc || rows <= 0 || probes < 0) usage(argv[0]);
+  if (density < 0 || density > 1) usage(argv[0]);
+  if (widths.empty())
+    for (int w = 256; w <= 16384; w *= 4) widths.push_back(w);
+
+  printf("%9s %10s %10s %10s %14s\n",
+	"width", "layout", "generate", "tiled", "revealed/s");
+  try
+  {
+    for (vector<int>::const_iterator w = widths.begin(); w != widths.end(); ++w)
+    {
+      if (*w <= 0) usage(argv[0]);
+      const int mines = int(rows * double(*w) * density);
+      Run runs[2];
+      for (int l = 0; l < 2; ++l)
+      {
+	runs[l] = run(rows, *w, mines, probes, seed, Layout(l));
+	printf("%9d %10s %9.3fs %9.3fs %14.0f\n",
+		*w, layout_name[l], runs[l].generate, runs[l].tiled,
+		runs[l].revealed/runs[l].fill);
+      }
+      if (runs[0].digest != runs[1].digest ||
+	  runs[0].revealed != runs[1].revealed)
+      {
+	printf("MISMATCH: layouts played different games\n");
+	return 1;
+      }
+    }
+  }
+  catch (const exception &e)
+  {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
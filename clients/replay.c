@@ -0,0 +1,146 @@
+/* Replay recorded games at full speed, e.g. for profiling.
+ *
+ * Usage:
+ *   replay LOGFILE [REPEAT]
+ *	Replay the log REPEAT times (default 1), verifying every move and
+ *	checkpoint, and report how long it took.
+ *   replay -r ROWS COLS MINES SEED LOGFILE
+ *	Play a game by following the library's hints, and record it in LOGFILE.
+ *	On large boards this makes a long, realistic session to replay.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "c_abi.h"
+
+enum { checkpoint_interval=1000 };
+
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec/1e9;
+}
+
+
+static char *read_file(const char name[])
+{
+  char *buf = NULL;
+  long size;
+  FILE *f = fopen(name, "rb");
+  if (!f) return NULL;
+  if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 &&
+      fseek(f, 0, SEEK_SET) == 0 && (buf = malloc(size+1)) != NULL)
+  {
+    if (fread(buf, 1, size, f) == (size_t)size)
+    {
+      buf[size] = '\0';
+    }
+    else
+    {
+      free(buf);
+      buf = NULL;
+    }
+  }
+  fclose(f);
+  return buf;
+}
+
+
+static int record(int rows, int cols, int mines, unsigned long seed,
+	const char name[])
+{
+  int row, col, size, result = 1;
+  char *buf;
+  FILE *f;
+  Minefield *game = mines_init_seeded(rows, cols, mines, seed);
+  MinesLog *log = mines_log_start(game, checkpoint_interval);
+  if (!log)
+  {
+    fprintf(stderr, "Could not start recording\n");
+    mines_close(game);
+    return 1;
+  }
+
+  while (mines_togo(game) && mines_hint(game, &row, &col) >= 0)
+    if (!mines_probe(game, row, col, 0)) break;
+  mines_log_stop(game);
+
+  buf = malloc(mines_log_savesize(log));
+  f = fopen(name, "wb");
+  if (buf && f)
+  {
+    size = mines_log_save(log, buf);
+    if (fwrite(buf, 1, size, f) == (size_t)size) result = 0;
+  }
+  if (f && fclose(f) != 0) result = 1;
+  if (result) perror(name);
+  else printf("Recorded %d moves, %d to go\n",
+	mines_log_moves(log), mines_togo(game));
+
+  free(buf);
+  mines_log_close(log);
+  mines_close(game);
+  return result;
+}
+
+
+static int replay(const char name[], int repeat)
+{
+  int i;
+  double start, elapsed;
+  MinesLog *log;
+  char *buf = read_file(name);
+  if (!buf)
+  {
+    perror(name);
+    return 1;
+  }
+  log = mines_log_load(buf);
+  free(buf);
+  if (!log)
+  {
+    fprintf(stderr, "%s: not a valid move log\n", name);
+    return 1;
+  }
+
+  start = now();
+  for (i = 0; i < repeat; ++i)
+  {
+    Minefield *game = mines_replay(log, 1);
+    if (!game)
+    {
+      fprintf(stderr, "%s: replay diverged from log\n", name);
+      mines_log_close(log);
+      return 1;
+    }
+    mines_close(game);
+  }
+  elapsed = now() - start;
+
+  printf("%d moves, %.3f ms per replay, %.3f us per move\n",
+	mines_log_moves(log),
+	elapsed*1e3/repeat,
+	mines_log_moves(log) ? elapsed*1e6/repeat/mines_log_moves(log) : 0.0);
+  mines_log_close(log);
+  return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc == 7 && strcmp(argv[1], "-r") == 0)
+    return record(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]),
+	strtoul(argv[5], NULL, 10), argv[6]);
+  if (argc == 2 || argc == 3)
+    return replay(argv[1], argc == 3 ? atoi(argv[2]) : 1);
+
+  fprintf(stderr,
+	"Usage: %s LOGFILE [REPEAT]\n"
+	"       %s -r ROWS COLS MINES SEED LOGFILE\n",
+	argv[0], argv[0]);
+  return 2;
+}
@@ -17,12 +17,38 @@ libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
 Suite 330, Boston, MA  02111-1307  USA
 */
 
+
 // A very basic sample user interface for a Minesweeper game based on libmines
+//
+// Usage: ui_cli [-r ROWS] [-c COLS] [-m MINES] [-s SEED] [-i INTELLIGENCE]
+//               [-v HEIGHTxWIDTH] [-f SCRIPT]
+//
+// Shows the part of the playing field that fits in the viewport, and follows
+// the patches you probe around the field.  Each line of input is a move:
+//
+//	ROW COL		probe patch (negative coordinate: say it's a mine)
+//	v ROW COL	show the area around this patch
+//	a		auto-complete: reveal everything that's obvious
+//	s		save game to mines.savedgame
+//	q		quit
+//
+// With -f, moves are read from SCRIPT ("-" for standard input) without showing
+// anything in between.  Hitting a mine doesn't end the session then; at the end
+// the program shows the viewport once, and reports how long it all took.
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -34,17 +60,83 @@ using namespace std;
 
 namespace
 {
-void coordsbar(int cols)
+/// Part of the playing field that gets shown
+struct Viewport
 {
-  cout << "\t ";
-  for (int i=0; i<cols; ++i)
+  int top, left, height, width;
+};
+
+
+/// Move viewport so that it shows patch, if it doesn't already
+void follow(Viewport &v, const Lake &L, int row, int col)
+{
+  if (row < v.top || row >= v.top + v.height) v.top = row - v.height/2;
+  if (col < v.left || col >= v.left + v.width) v.left = col - v.width/2;
+  v.top = max(0, min(v.top, L.rows() - v.height));
+  v.left = max(0, min(v.left, L.cols() - v.width));
+}
+
+
+void coordsbar(string &out, const Viewport &v)
+{
+  out += "\t ";
+  for (int i = v.left; i < v.left + v.width; ++i)
   {
-    if (i<10) cout << ' ';
-    cout << i;
+    // Only the last two digits fit
+    out += (i >= 10 ? char('0' + i/10%10) : ' ');
+    out += char('0' + i%10);
   }
-  cout << endl;
+  out += '\n';
 }
 
+
+/// Build one complete screenful, to be written in one go
+void render(string &frame, const Lake &L, const Viewport &v)
+{
+  ostringstream head;
+  head << "Clear patches to go: " << L.to_go() << "...";
+  if (v.height < L.rows() || v.width < L.cols())
+    head << "  (showing rows " << v.top << '-' << v.top+v.height-1
+	 << ", columns " << v.left << '-' << v.left+v.width-1 << ")";
+  head << "\n";
+
+  frame = head.str();
+  coordsbar(frame, v);
+  frame += '\n';
+
+  // The patches just outside the field only show when the viewport is there
+  const int first = (v.top ? v.top : -1),
+	    last = v.top + v.height - (v.top + v.height < L.rows());
+  for (int r = first; r <= last; ++r)
+  {
+    char label[16];
+    label[0] = '\0';
+    if (r >= 0 && r < L.rows()) sprintf(label, "%d", r);
+    frame += label;
+    frame += '\t';
+
+    frame += (v.left ? ' ' : L.status_at(r,-1));
+    frame += ' ';
+    for (int c = v.left; c < v.left + v.width; ++c)
+    {
+      frame += L.status_at(r,c);
+      frame += ' ';
+    }
+    frame += (v.left + v.width < L.cols() ? ' ' : L.status_at(r,L.cols()));
+    frame += ' ';
+
+    if (r >= 0 && r < L.rows())
+    {
+      if (r <= 9) frame += ' ';
+      frame += label;
+    }
+    frame += '\n';
+  }
+  frame += '\n';
+  coordsbar(frame, v);
+}
+
+
 void save_game(const Lake &L)
 {
   assert(L.savesize() == L.savesize());
@@ -78,71 +170,165 @@ void save_game(const Lake &L)
 }
 
 
+/// Current time in seconds
+double now()
+{
+  return chrono::duration<double>(
+	chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 
+void usage(const char name[])
+{
+  cerr << "Usage: " << name << " [-r ROWS] [-c COLS] [-m MINES] [-s SEED] "
+	"[-i INTELLIGENCE] [-v HEIGHTxWIDTH] [-f SCRIPT]" << endl;
+  exit(2);
+}
 } // namespace
 
 
-int main()
+int main(int argc, char *argv[])
 {
-  int rows=20, cols=30, mines=250;
+  int rows=20, cols=30, mines=250, intelligence=Lake::max_intelligence();
+  unsigned long seed = getpid()^time(NULL);
+  Viewport view = { 0, 0, 20, 30 };
+  const char *script = 0;
+
+  for (int opt; (opt = getopt(argc, argv, "r:c:m:s:i:v:f:")) != -1; )
+  {
+    switch (opt)
+    {
+    case 'r': rows = atoi(optarg); break;
+    case 'c': cols = atoi(optarg); break;
+    case 'm': mines = atoi(optarg); break;
+    case 's': seed = strtoul(optarg, 0, 10); break;
+    case 'i': intelligence = atoi(optarg); break;
+    case 'v':
+      if (sscanf(optarg, "%dx%d", &view.height, &view.width) != 2)
+	usage(argv[0]);
+      break;
+    case 'f': script = optarg; break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind != argc || view.height <= 0 || view.width <= 0) usage(argv[0]);
 
-  srand(getpid()^time(NULL));
+  ifstream scriptfile;
+  if (script && string(script) != "-")
+  {
+    scriptfile.open(script);
+    if (!scriptfile)
+    {
+      cerr << "Could not open " << script << endl;
+      return 1;
+    }
+  }
+  istream &input = (scriptfile.is_open() ? scriptfile : cin);
+  const bool interactive = !script;
 
+  int probes = 0, booms = 0, lineno = 0;
+  double busy = 0;
+  const double start = now();
   try
   {
     cout << "Creating minefield of "
          <<rows<<"x"<<cols<<" fields, "<<mines<<" mines." << endl;
-    Lake L(rows,cols,mines);
-    L.set_intelligence(Lake::max_intelligence());
-    while (L.to_go())
+    Lake L(rows,cols,mines,seed,square_topology);
+    L.set_intelligence(intelligence);
+    L.index_openings(true);
+    view.height = min(view.height, rows);
+    view.width = min(view.width, cols);
+
+    string frame, line;
+    bool quit = false;
+    while (L.to_go() && !quit)
     {
-      save_game(L);
-      cout << "Clear patches to go: " << L.to_go() << "..." << endl;
-      coordsbar(cols);
-      cout << endl;
-      for (int r=-1; r<=rows; ++r)
+      if (interactive)
       {
-	if (r>=0 && r<rows) cout << r;
-	cout << '\t';
-	for (int c=-1; c<=cols; ++c) cout << L.status_at(r,c) << ' ';
-	if (r >= 0 && r<rows)
+	render(frame, L, view);
+	frame += "Please enter row and column (zero-based, separated by space) "
+	  "of next patch you think is mine-free, or make either coordinate "
+	  "negative if you want to indicate a mine:\n";
+	cout.write(frame.data(), frame.size());
+	cout.flush();
+      }
+
+      if (!getline(input, line)) break;
+      ++lineno;
+      istringstream words(line);
+      string cmd;
+      if (!(words >> cmd) || cmd[0] == '#') continue;
+
+      int r, c;
+      if (cmd == "q")
+      {
+	quit = true;
+      }
+      else if (cmd == "s")
+      {
+	save_game(L);
+      }
+      else if (cmd == "a")
+      {
+	set<Coords> changes;
+	const double t = now();
+	L.solve_obvious(changes);
+	busy += now() - t;
+      }
+      else if (cmd == "v" && words >> r >> c)
+      {
+	follow(view, L, r, c);
+      }
+      else if (istringstream(line) >> r >> c)
+      {
+	set<Coords> changes;
+	bool thinksismine = false;
+	if (r < 0 || c < 0)
+	{
+	  thinksismine = true;
+	  r = abs(r);
+	  c = abs(c);
+	}
+	if (r >= rows || c >= cols)
+	{
+	  cout << "Out of range!" << endl;
+	  continue;
+	}
+	++probes;
+	if (interactive) follow(view, L, r, c);
+	const double t = now();
+	try
+	{
+	  L.probe(r,c,changes,thinksismine);
+	}
+	catch (const Boom &)
 	{
-	  if (r <= 9) cout << ' ';
-	  cout << r;
+	  busy += now() - t;
+	  // A script plays on regardless, to get through the whole session
+	  if (interactive) throw;
+	  ++booms;
+	  continue;
 	}
-	/*
-	cout << '\t';
-	for (int c=-1; c<=cols; ++c) cout << L.at(r,c).near_hiddenmines();
-	cout << '\t';
-	for (int c=-1; c<=cols; ++c) cout << L.at(r,c).near_unknown();
-	cout << '\t';
-	for (int c=-1; c<=cols; ++c) cout << (L.at(r,c).mined()?'*':'^');
-	*/
-	cout << endl;
+	busy += now() - t;
       }
-      cout << endl;
-      coordsbar(cols);
-      cout <<
-	"Please enter row and column (zero-based, separated by space) of next "
-	"patch you think is mine-free, or make either coordinate negative if "
-	"you want to indicate a mine:"
-	<< endl;
-      int r, c;
-      cin >> r >> c;
-      cout << endl;
-      set<Coords> changes;
-      bool thinksismine = false;
-      if (r < 0 || c < 0)
+      else
       {
-        thinksismine = true;
-        r = abs(r);
-        c = abs(c);
+	if (!interactive)
+	{
+	  cerr << "Line " << lineno << ": can't make sense of '" << line << "'"
+	       << endl;
+	  return 1;
+	}
+	cout << "Can't make sense of that." << endl;
       }
-      if (r >= rows || c >= cols) cout<<"Out of range!"<<endl;
-      else L.probe(r,c,changes,thinksismine);
     }
 
-    cout << "Field cleared.  Congratulations!" << endl;
+    if (!interactive)
+    {
+      render(frame, L, view);
+      cout.write(frame.data(), frame.size());
+    }
+    if (!L.to_go()) cout << "Field cleared.  Congratulations!" << endl;
   }
   catch (const Boom &b)
   {
@@ -157,6 +343,13 @@ int main()
     cerr << e.what() << endl;
     return 1;
   }
+
+  if (!interactive)
+  {
+    const double elapsed = now() - start;
+    cout << probes << " probes (" << booms << " mines hit) in " << elapsed
+	 << "s, of which " << busy << "s in the game logic ("
+	 << (busy > 0 ? probes/busy : 0) << " probes/s)" << endl;
+  }
   return 0;
 }
-
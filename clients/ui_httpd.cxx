@@ -0,0 +1,1042 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Stand-alone web server for Minesweeper, serving the same pages as ui_web
+//
+// Usage: ui_httpd [-p PORT] [-t THREADS] [-a ARCHIVE]
+//
+// Games are kept in memory, in a GameTable shared by all worker threads.  By
+// default there is one worker per processor core.  Each worker has its own
+// listening socket (the kernel spreads new connections over them) and its own
+// epoll loop, and serves HTTP/1.1 with keep-alive.  With -a, every new game and
+// every move is queued for storage in the given game archive, and games that
+// are not in memory, e.g. after a restart, are loaded from there.  Games that
+// have been idle for a while are dropped from memory then, since they can be
+// loaded again when needed.  Without an archive, that would lose them, so the
+// server refuses to start new games once it holds a maximum number of them.
+// SIGINT or SIGTERM stops the server, after writing out any games still
+// queued.
+//
+// Try: curl 'http://localhost:8080/?rows=16&cols=30&mines=99'
+//
+// A request must either name a game, or give rows, cols, and mines for a new
+// one.  A request that does neither gets an empty page, or from /json, a "400
+// Bad Request" with the error "No game given".
+//
+// The same requests sent to /json instead of / get a compact JSON answer, for
+// scripts and AJAX clients: the game's id and counters, its state ("playing",
+// "won", or "lost", with "boom" giving the fatal move), and a list "changes"
+// of the patches revealed by this move, each as [row, col, status].  Add full=1
+// to the query to get the whole playing field as well, as a string "board" of
+// status characters, row by row.
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "archive.hxx"
+#include "gamelogic.hxx"
+#include "gametable.hxx"
+#include "savequeue.hxx"
+
+using namespace std;
+
+
+namespace
+{
+const char
+page_header[] =
+  "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+  "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Strict//EN\" "
+  "\"http://www.w3.org/TR/xhtml1/DTD/xhtml1-strict.dtd\">\n"
+  "<html xml:lang=\"en\" lang=\"en\">\n"
+  "<head>"
+  "<meta http-equiv=\"Content-Type\" "
+  "content=\"text/xhtml+xml; charset=utf-8\" />\n"
+  "<title>Minesweeper</title>"
+  "<style type=\"text/css\">"
+  "td {"
+  "width: 1em;"
+  "padding: 0;"
+  "}\n"
+  "a {"
+  "text-decoration: none;"
+  "width: 1em;"
+  "padding: 0;"
+  "}\n"
+  "a:hover {"
+  "background-color: #808080;"
+  "}\n"
+  "tt {"
+  "width: 1em;"
+  "}\n"
+  "</style>"
+  "</head>"
+  "<body>\n",
+toolarge[] =
+  "<p><em>Playing field too large.  Try something smaller!</em></p>\n",
+toomany[] = "<p><em>That's too many mines!</em></p>\n",
+notfound[] = "<p><em>Game not found</em></p>\n",
+badid[] = "<p><em>Invalid game identifier</em></p>\n",
+busy[] = "<p><em>Too many games in play.  Try again later!</em></p>\n",
+youwin[] = "<h1>You win.  Congratulations!</h1>\n",
+youlose[] = "<h1><em>Boom!</em>  You lose.</h1>\n",
+page_footer[] = "</body></html>\n";
+
+const char
+html_type[] = "text/html; charset=utf-8",
+json_type[] = "application/json";
+
+/// Why a request has no game to show
+enum Problem
+{
+  no_game,
+  bad_id,
+  too_large,
+  too_many,
+  not_found,
+  too_busy,
+  no_problem
+};
+
+/// Page content for each Problem
+const char *const html_problems[] =
+	{ "", badid, toolarge, toomany, notfound, busy };
+
+/// JSON error message for each Problem
+const char *const json_problems[] =
+{
+  "No game given",
+  "Invalid game identifier",
+  "Playing field too large",
+  "Too many mines",
+  "Game not found",
+  "Too many games in play"
+};
+
+enum { idlen=16 };
+enum { maxsize=16384 };
+
+/// Requests whose headers grow beyond this are refused
+enum { max_request=8192 };
+/// Stop reading from a client while this much output is waiting to be sent
+enum { max_backlog=1<<20 };
+/// Without an archive, refuse to start new games once this many are in memory
+enum { max_games=100000 };
+/// With an archive, drop games from memory once idle for this many seconds
+enum { idle_time=300 };
+
+/// Set by signal handler; lock-free, so safe to use from one
+atomic<bool> stopping(false);
+
+extern "C" void stop_server(int)
+{
+  stopping = true;
+}
+
+
+/// Parameters of a request for a game page
+struct Query
+{
+  Query() :
+    id(0), has_id(false), bad_id(false),
+    rows(0), cols(0), mines(0), intelligence(Lake::max_intelligence()),
+    row(0), col(0), has_coords(false), full(false)
+  {
+  }
+
+  uint64_t id;
+  bool has_id, bad_id;
+  int rows, cols, mines, intelligence;
+  int row, col;
+  bool has_coords;
+  /// Include whole playing field in JSON answer
+  bool full;
+};
+
+
+/// Find first occurrence of c in [begin, end), or null
+const char *find(const char *begin, const char *end, char c)
+{
+  return static_cast<const char *>(memchr(begin, c, end-begin));
+}
+
+
+bool read_id(const char *pos, const char *end, uint64_t &id)
+{
+  if (end - pos < idlen) return false;
+  id = 0;
+  for (int i = 0; i < idlen; ++i)
+  {
+    const char c = pos[i];
+    int digit;
+    if (c >= '0' && c <= '9') digit = c - '0';
+    else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+    else return false;
+    id = (id << 4) | digit;
+  }
+  return true;
+}
+
+
+/// Parse query string, same as ui_web
+Query parse_query(const char *pos, const char *end)
+{
+  Query q;
+  while (pos < end)
+  {
+    const char *const next = find(pos, end, '&');
+    const char *const stop = next ? next : end;
+    const char *const eq = find(pos, stop, '=');
+    if (eq)
+    {
+      const string key(pos, eq);
+      const int value = atoi(string(eq+1, stop).c_str());
+      if (key == "game")
+      {
+	q.has_id = true;
+	q.bad_id = !read_id(eq+1, stop, q.id);
+      }
+      else if (key == "rows") q.rows = value;
+      else if (key == "cols") q.cols = value;
+      else if (key == "mines") q.mines = value;
+      else if (key == "intl") q.intelligence = value;
+      else if (key == "atr") { q.row = value; q.has_coords = true; }
+      else if (key == "atc") { q.col = value; q.has_coords = true; }
+      else if (key == "full") q.full = (value != 0);
+    }
+    pos = next ? next+1 : end;
+  }
+  return q;
+}
+
+
+void append_int(string &out, int n)
+{
+  char buf[16];
+  out.append(buf, snprintf(buf, sizeof(buf), "%d", n));
+}
+
+
+void append_id(string &out, uint64_t id)
+{
+  char buf[idlen+1];
+  snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(id));
+  out.append(buf, idlen);
+}
+
+
+enum Outcome { playing, won, lost };
+
+/// Make the move asked for in query, if any, and say how the game stands
+/** @param changes receives the patches revealed by the move
+ * @param boom receives the fatal move's position, if the game is lost
+ */
+Outcome play(Lake &L, const Query &q, set<Coords> &changes, Coords &boom)
+{
+  if (!L.to_go()) return won;
+  if (!q.has_coords ||
+      q.row < 0 || q.row >= L.rows() || q.col < 0 || q.col >= L.cols())
+    return playing;
+
+  try
+  {
+    L.probe(q.row, q.col, changes);
+  }
+  catch (const Boom &b)
+  {
+    boom = b.position;
+    return lost;
+  }
+  return L.to_go() ? playing : won;
+}
+
+
+/// Queue game for storage if this request started it, or made a move in it
+void store(SaveQueue *queue,
+	uint64_t id,
+	const Lake &L,
+	const Query &q,
+	int moves_before)
+{
+  if (queue && (!q.has_id || L.moves() != moves_before)) queue->store(id, L);
+}
+
+
+/// Functor: play a move in a game and render its page, while it's locked
+class PagePlayer
+{
+public:
+  PagePlayer(uint64_t id, const Query &q, string &body, SaveQueue *queue) :
+    m_id(id), m_query(q), m_body(body), m_queue(queue) {}
+
+  void operator()(Lake &L) const
+  {
+    set<Coords> changes;
+    Coords boom(0, 0);
+    const int moves = L.moves();
+    const Outcome outcome = play(L, m_query, changes, boom);
+    if (outcome == won) m_body += youwin;
+    else if (outcome == lost) m_body += youlose;
+    const bool done = (outcome != playing);
+
+    m_body += "<p>Moves: ";
+    append_int(m_body, L.moves());
+    m_body += ".  Fields to go: ";
+    append_int(m_body, L.to_go());
+    m_body += "</p>\n<form action=\"/\" method=\"get\"><tt><table>";
+
+    string link = "<td><a href=\"/?game=";
+    append_id(link, m_id);
+    link += "&amp;atr=";
+    const size_t linkhead = link.size();
+    for (int r = -1; r <= L.rows(); ++r)
+    {
+      link.resize(linkhead);
+      append_int(link, r);
+      link += "&amp;atc=";
+      m_body += "<tr>";
+      for (int c = -1; c <= L.cols(); ++c)
+      {
+	const char x = L.status_at(r, c);
+	if (done || x != '^')
+	{
+	  m_body += "<td>";
+	  m_body += x;
+	  m_body += "</td>";
+	}
+	else
+	{
+	  m_body += link;
+	  append_int(m_body, c);
+	  m_body += "\">=</a></td>";
+	}
+      }
+      m_body += "</tr>\n";
+    }
+    m_body += "</table></tt></form>\n";
+
+    store(m_queue, m_id, L, m_query, moves);
+  }
+
+private:
+  uint64_t m_id;
+  const Query &m_query;
+  string &m_body;
+  SaveQueue *m_queue;
+};
+
+
+/// Functor: play a move in a game and describe the result in JSON
+class JsonPlayer
+{
+public:
+  JsonPlayer(uint64_t id, const Query &q, string &body, SaveQueue *queue) :
+    m_id(id), m_query(q), m_body(body), m_queue(queue) {}
+
+  void operator()(Lake &L) const
+  {
+    static const char *const states[] = { "playing", "won", "lost" };
+    set<Coords> changes;
+    Coords boom(0, 0);
+    const int moves = L.moves();
+    const Outcome outcome = play(L, m_query, changes, boom);
+
+    m_body += "{\"game\":\"";
+    append_id(m_body, m_id);
+    m_body += "\",\"rows\":";
+    append_int(m_body, L.rows());
+    m_body += ",\"cols\":";
+    append_int(m_body, L.cols());
+    m_body += ",\"moves\":";
+    append_int(m_body, L.moves());
+    m_body += ",\"togo\":";
+    append_int(m_body, L.to_go());
+    m_body += ",\"state\":\"";
+    m_body += states[outcome];
+    m_body += '"';
+    if (outcome == lost)
+    {
+      m_body += ",\"boom\":[";
+      append_int(m_body, boom.row);
+      m_body += ',';
+      append_int(m_body, boom.col);
+      m_body += ']';
+    }
+
+    m_body += ",\"changes\":[";
+    typedef set<Coords>::const_iterator iter;
+    for (iter i = changes.begin(); i != changes.end(); ++i)
+    {
+      if (i != changes.begin()) m_body += ',';
+      m_body += '[';
+      append_int(m_body, i->row);
+      m_body += ',';
+      append_int(m_body, i->col);
+      m_body += ",\"";
+      m_body += L.status_at(i->row, i->col);
+      m_body += "\"]";
+    }
+    m_body += ']';
+
+    if (m_query.full)
+    {
+      m_body += ",\"board\":\"";
+      for (int r = 0; r < L.rows(); ++r)
+	for (int c = 0; c < L.cols(); ++c)
+	  m_body += L.status_at(r, c);
+      m_body += '"';
+    }
+    m_body += "}\n";
+
+    store(m_queue, m_id, L, m_query, moves);
+  }
+
+private:
+  uint64_t m_id;
+  const Query &m_query;
+  string &m_body;
+  SaveQueue *m_queue;
+};
+
+
+/// Games and storage shared by all workers
+struct Games
+{
+  Games() : table(1024), queue(0), archive_path() {}
+
+  GameTable table;
+  /// Write-behind storage, or null if games are only kept in memory
+  SaveQueue *queue;
+  string archive_path;
+};
+
+
+/// One client connection, with its buffered input and output
+struct Connection
+{
+  explicit Connection(int f) : fd(f), in(), out(), sent(0), closing(false) {}
+
+  int fd;
+  string in, out;
+  /// Number of bytes at the start of out that have been sent already
+  size_t sent;
+  /// Close connection once all output has been sent
+  bool closing;
+};
+
+
+/// Worker thread: serves connections accepted on its own listening socket
+class Worker
+{
+public:
+  Worker(int listener, Games &games) :
+    m_listener(listener),
+    m_epoll(-1),
+    m_games(games),
+    m_archive(),
+    m_entropy()
+  {
+  }
+
+  void run();
+
+private:
+  void accept_all();
+  void handle(Connection *, uint32_t events);
+  /// Read what's available; returns false if the client went away
+  bool receive(Connection *);
+  /// Send what we can; returns false if the client went away
+  bool transmit(Connection *);
+  /// Answer complete requests in input buffer
+  /** Returns true if it stopped because too much output was waiting.
+   */
+  bool process(Connection *);
+  void respond(Connection *, const char *line, const char *end);
+  void reply(Connection *,
+	const char status[],
+	const char type[],
+	const string &body,
+	bool head,
+	bool keep_alive);
+  /// Play the move asked for, with a PLAYER functor rendering the result
+  template<typename PLAYER> Problem play_game(const Query &, string &body);
+  /// Start game as asked for in query, and set id to identify it
+  Problem start_game(const Query &, uint64_t &id);
+  /// Unpredictable 64-bit number, for a game's id or seed
+  uint64_t random64() { return (uint64_t(m_entropy()) << 32) ^ m_entropy(); }
+  Lake *find_stored(uint64_t id);
+  void watch(Connection *, uint32_t events, int op);
+  void drop(Connection *);
+
+  int m_listener, m_epoll;
+  Games &m_games;
+  /// This worker's own handle on the archive, for loading games
+  GameArchive *m_archive;
+  /// Source of games' ids and seeds
+  /** These must be unpredictable.  A client who could predict them could play
+   * other people's games, or know where the mines are in new ones.
+   */
+  random_device m_entropy;
+};
+
+
+void Worker::run()
+{
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll == -1) throw runtime_error("Could not create epoll instance");
+  if (!m_games.archive_path.empty())
+    m_archive = new GameArchive(m_games.archive_path);
+
+  epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = 0;
+  if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listener, &ev) != 0)
+    throw runtime_error("Could not watch listening socket");
+
+  epoll_event events[256];
+  while (!stopping)
+  {
+    const int n = epoll_wait(m_epoll, events, 256, 200);
+    for (int i = 0; i < n; ++i)
+    {
+      Connection *const c = static_cast<Connection *>(events[i].data.ptr);
+      if (c) handle(c, events[i].events);
+      else accept_all();
+    }
+  }
+
+  // Connections still open are closed when the process exits
+  delete m_archive;
+  close(m_epoll);
+}
+
+
+void Worker::accept_all()
+{
+  for (;;)
+  {
+    const int fd = accept4(m_listener, 0, 0, SOCK_NONBLOCK|SOCK_CLOEXEC);
+    if (fd == -1)
+    {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      // EAGAIN means we've had them all.  Anything else (e.g. running out of
+      // file descriptors) we can't fix here; try again on the next event.
+      return;
+    }
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    watch(new Connection(fd), EPOLLIN, EPOLL_CTL_ADD);
+  }
+}
+
+
+void Worker::watch(Connection *c, uint32_t events, int op)
+{
+  epoll_event ev;
+  ev.events = events;
+  ev.data.ptr = c;
+  if (epoll_ctl(m_epoll, op, c->fd, &ev) != 0)
+  {
+    if (op == EPOLL_CTL_ADD)
+    {
+      close(c->fd);
+      delete c;
+    }
+    else
+    {
+      drop(c);
+    }
+  }
+}
+
+
+void Worker::drop(Connection *c)
+{
+  // Closing the socket also removes it from the epoll set
+  close(c->fd);
+  delete c;
+}
+
+
+void Worker::handle(Connection *c, uint32_t events)
+{
+  if (events & (EPOLLERR|EPOLLHUP))
+  {
+    drop(c);
+    return;
+  }
+
+  if ((events & EPOLLIN) && !receive(c))
+  {
+    drop(c);
+    return;
+  }
+
+  for (bool more = true; more; )
+  {
+    more = process(c);
+    if (!transmit(c))
+    {
+      drop(c);
+      return;
+    }
+
+    if (c->sent < c->out.size())
+    {
+      // Wait until the client can take more, before reading more requests
+      if (!(events & EPOLLOUT)) watch(c, EPOLLOUT, EPOLL_CTL_MOD);
+      return;
+    }
+    c->out.clear();
+    c->sent = 0;
+    if (c->closing)
+    {
+      drop(c);
+      return;
+    }
+  }
+
+  if (events & EPOLLOUT)
+  {
+    // Output drained.  Requests may have been waiting in the meantime.
+    watch(c, EPOLLIN, EPOLL_CTL_MOD);
+  }
+}
+
+
+bool Worker::receive(Connection *c)
+{
+  char buf[16384];
+  for (;;)
+  {
+    const ssize_t bytes = read(c->fd, buf, sizeof(buf));
+    if (bytes > 0)
+    {
+      c->in.append(buf, bytes);
+      if (c->in.size() > max_request + sizeof(buf)) return true;
+      continue;
+    }
+    if (bytes == 0) return false;
+    if (errno == EINTR) continue;
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+  }
+}
+
+
+bool Worker::transmit(Connection *c)
+{
+  while (c->sent < c->out.size())
+  {
+    const ssize_t bytes = send(c->fd, c->out.data() + c->sent,
+	c->out.size() - c->sent, MSG_NOSIGNAL);
+    if (bytes > 0)
+    {
+      c->sent += bytes;
+      continue;
+    }
+    if (bytes == -1 && errno == EINTR) continue;
+    return bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+  return true;
+}
+
+
+bool Worker::process(Connection *c)
+{
+  size_t start = 0;
+  bool full = false;
+  while (!c->closing && !(full = (c->out.size() >= max_backlog)))
+  {
+    const size_t end = c->in.find("\r\n\r\n", start);
+    if (end == string::npos)
+    {
+      if (c->in.size() - start > max_request)
+      {
+	reply(c, "431 Request Header Fields Too Large", html_type, "",
+	    false, false);
+	start = c->in.size();
+      }
+      break;
+    }
+    respond(c, c->in.data() + start, c->in.data() + end + 2);
+    start = end + 4;
+  }
+  c->in.erase(0, start);
+  return full;
+}
+
+
+/// Is header line (excluding CRLF) named name, with value containing word?
+bool header_has(const char *line, const char *end, const char name[],
+	const char word[])
+{
+  const size_t len = strlen(name);
+  if (size_t(end - line) <= len || line[len] != ':' ||
+      strncasecmp(line, name, len) != 0)
+    return false;
+  const string value(line + len + 1, end);
+  const size_t wordlen = strlen(word);
+  for (size_t i = 0; i + wordlen <= value.size(); ++i)
+    if (strncasecmp(value.c_str() + i, word, wordlen) == 0) return true;
+  return false;
+}
+
+
+void Worker::respond(Connection *c, const char *line, const char *end)
+{
+  // Request line: METHOD TARGET VERSION
+  const char *const eol = find(line, end, '\r');
+  const char *const sp1 = find(line, eol, ' ');
+  const char *const sp2 =
+	sp1 ? find(sp1+1, eol, ' ') : 0;
+  if (!sp2)
+  {
+    reply(c, "400 Bad Request", html_type, "", false, false);
+    return;
+  }
+  const string method(line, sp1), version(sp2+1, eol);
+  bool keep_alive = (version == "HTTP/1.1");
+  bool body = false;
+  for (const char *h = eol + 2; h < end; )
+  {
+    const char *const hend = find(h, end, '\r');
+    if (header_has(h, hend, "Connection", "close")) keep_alive = false;
+    else if (header_has(h, hend, "Connection", "keep-alive")) keep_alive = true;
+    else if (header_has(h, hend, "Transfer-Encoding", "") ||
+	(header_has(h, hend, "Content-Length", "") &&
+	 atoi(string(h + 15, hend).c_str()) != 0))
+      body = true;
+    h = hend + 2;
+  }
+
+  const bool head = (method == "HEAD");
+  if (version.compare(0, 5, "HTTP/") != 0)
+    reply(c, "400 Bad Request", html_type, "", false, false);
+  else if (body)
+    // We never read request bodies, so we can't tell where the next request
+    // would start.
+    reply(c, "413 Payload Too Large", html_type, "", false, false);
+  else if (method != "GET" && !head)
+    reply(c, "405 Method Not Allowed", html_type, "", false, false);
+  else
+  {
+    const char *const target = sp1 + 1;
+    const char *const query = find(target, sp2, '?');
+    const string path(target, query ? query : sp2);
+    const bool json = (path == "/json");
+    if (!json && path != "/")
+    {
+      reply(c, "404 Not Found", html_type, "", head, keep_alive);
+      return;
+    }
+
+    const Query q = parse_query(query ? query+1 : sp2, sp2);
+    string content = json ? "" : page_header;
+    Problem problem;
+    try
+    {
+      if (json) problem = play_game<JsonPlayer>(q, content);
+      else problem = play_game<PagePlayer>(q, content);
+    }
+    catch (const exception &e)
+    {
+      fprintf(stderr, "%s\n", e.what());
+      reply(c, "500 Internal Server Error", html_type, "", head, false);
+      return;
+    }
+
+    if (!json)
+    {
+      if (problem != no_problem) content += html_problems[problem];
+      content += page_footer;
+      reply(c, "200 OK", html_type, content, head, keep_alive);
+    }
+    else if (problem == no_problem)
+    {
+      reply(c, "200 OK", json_type, content, head, keep_alive);
+    }
+    else
+    {
+      content = "{\"error\":\"";
+      content += json_problems[problem];
+      content += "\"}\n";
+      const char *const status =
+	(problem == not_found) ? "404 Not Found" :
+	(problem == too_busy) ? "503 Service Unavailable" :
+	"400 Bad Request";
+      reply(c, status, json_type, content, head, keep_alive);
+    }
+  }
+}
+
+
+void Worker::reply(Connection *c,
+	const char status[],
+	const char type[],
+	const string &body,
+	bool head,
+	bool keep_alive)
+{
+  string &out = c->out;
+  out += "HTTP/1.1 ";
+  out += status;
+  out += "\r\nContent-Type: ";
+  out += type;
+  out += "\r\nContent-Length: ";
+  append_int(out, int(body.size()));
+  out += keep_alive ? "\r\nConnection: keep-alive" : "\r\nConnection: close";
+  out += "\r\n\r\n";
+  if (!head) out += body;
+  if (!keep_alive) c->closing = true;
+}
+
+
+Lake *Worker::find_stored(uint64_t id)
+{
+  if (!m_archive) return 0;
+  try
+  {
+    return m_archive->load(id);
+  }
+  catch (const exception &e)
+  {
+    fprintf(stderr, "Could not load game: %s\n", e.what());
+  }
+  return 0;
+}
+
+
+template<typename PLAYER>
+Problem Worker::play_game(const Query &q, string &body)
+{
+  uint64_t id = q.id;
+  if (q.bad_id) return bad_id;
+  if (!q.has_id)
+  {
+    const Problem p = start_game(q, id);
+    if (p != no_problem) return p;
+  }
+
+  const PLAYER player(id, q, body, m_games.queue);
+  if (m_games.table.apply(id, player)) return no_problem;
+
+  // Not in memory.  If it was stored earlier, take it in.
+  Lake *const L = find_stored(id);
+  if (L && !m_games.table.insert(id, L)) delete L;
+  return (L && m_games.table.apply(id, player)) ? no_problem : not_found;
+}
+
+
+Problem Worker::start_game(const Query &q, uint64_t &id)
+{
+  if (!q.rows || !q.cols || !q.mines) return no_game;
+  if (q.rows < 0 || q.cols < 0 ||
+      q.rows > maxsize || q.cols > maxsize || q.rows*q.cols > maxsize)
+    return too_large;
+  if (q.mines < 0 || q.mines >= q.rows*q.cols) return too_many;
+  if (!m_games.queue && m_games.table.size() >= max_games) return too_busy;
+
+  Lake *const L = new Lake(q.rows, q.cols, q.mines, random64());
+  L->set_intelligence(q.intelligence);
+  do id = random64(); while (!m_games.table.insert(id, L));
+  return no_problem;
+}
+
+
+int listen_on(int port)
+{
+  const int fd = socket(AF_INET6, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+  if (fd == -1) throw runtime_error("Could not create socket");
+  const int on = 1, off = 0;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+  setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+  sockaddr_in6 addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin6_family = AF_INET6;
+  addr.sin6_addr = in6addr_any;
+  addr.sin6_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, SOMAXCONN) != 0)
+  {
+    const string error = strerror(errno);
+    close(fd);
+    throw runtime_error("Could not listen on port: " + error);
+  }
+  return fd;
+}
+
+
+void serve(Worker *w)
+{
+  try
+  {
+    w->run();
+  }
+  catch (const exception &e)
+  {
+    fprintf(stderr, "Worker failed: %s\n", e.what());
+    stopping = true;
+  }
+}
+
+
+/// Predicate: has game made no moves since the last sweep?
+/** Notes the moves made in each game that it keeps, for the next sweep.
+ */
+class idle_game
+{
+public:
+  idle_game(const map<uint64_t,int> &last, map<uint64_t,int> &now) :
+    m_last(last), m_now(now) {}
+  bool operator()(uint64_t id, const Lake &L) const
+  {
+    const map<uint64_t,int>::const_iterator i = m_last.find(id);
+    if (i != m_last.end() && i->second == L.moves()) return true;
+    m_now[id] = L.moves();
+    return false;
+  }
+
+private:
+  const map<uint64_t,int> &m_last;
+  map<uint64_t,int> &m_now;
+};
+
+
+/// Drop games that made no moves for idle_time seconds, until server stops
+/** A game is queued for storage whenever it changes.  Once the queue has been
+ * flushed, a game that hasn't changed since the previous sweep is safely in
+ * the archive, and can be loaded again from there when it's needed.
+ */
+void evict_idle(Games &games)
+{
+  typedef chrono::steady_clock clock;
+  map<uint64_t,int> last, now;
+  clock::time_point sweep = clock::now() + chrono::seconds(idle_time);
+  while (!stopping)
+  {
+    this_thread::sleep_for(chrono::milliseconds(200));
+    if (clock::now() < sweep) continue;
+    sweep = clock::now() + chrono::seconds(idle_time);
+
+    try
+    {
+      games.queue->flush();
+    }
+    catch (const exception &e)
+    {
+      fprintf(stderr, "Could not store games: %s\n", e.what());
+      continue;
+    }
+    games.table.remove_if(idle_game(last, now));
+    last.swap(now);
+    now.clear();
+  }
+}
+
+
+void usage(const char name[])
+{
+  fprintf(stderr, "Usage: %s [-p PORT] [-t THREADS] [-a ARCHIVE]\n", name);
+  exit(2);
+}
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+  int port = 8080, threads = thread::hardware_concurrency();
+  Games games;
+  for (int opt; (opt = getopt(argc, argv, "p:t:a:")) != -1; )
+  {
+    switch (opt)
+    {
+    case 'p': port = atoi(optarg); break;
+    case 't': threads = atoi(optarg); break;
+    case 'a': games.archive_path = optarg; break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind != argc || port <= 0 || port > 65535) usage(argv[0]);
+  if (threads <= 0) threads = 1;
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stop_server;
+  sigaction(SIGINT, &sa, 0);
+  sigaction(SIGTERM, &sa, 0);
+  signal(SIGPIPE, SIG_IGN);
+
+  vector<Worker *> workers;
+  vector<thread> running;
+  try
+  {
+    if (!games.archive_path.empty())
+      games.queue = new SaveQueue(games.archive_path);
+    for (int i = 0; i < threads; ++i)
+      workers.push_back(new Worker(listen_on(port), games));
+  }
+  catch (const exception &e)
+  {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+
+  for (size_t i = 0; i < workers.size(); ++i)
+    running.push_back(thread(serve, workers[i]));
+  if (games.queue) evict_idle(games);
+  for (size_t i = 0; i < running.size(); ++i) running[i].join();
+  for (size_t i = 0; i < workers.size(); ++i) delete workers[i];
+
+  int result = 0;
+  if (games.queue)
+  {
+    try
+    {
+      games.queue->flush();
+    }
+    catch (const exception &e)
+    {
+      fprintf(stderr, "Could not store games: %s\n", e.what());
+      result = 1;
+    }
+    delete games.queue;
+  }
+  return result;
+}
@@ -5,7 +5,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <unistd.h>
 
 #include "c_abi.h"
@@ -58,9 +57,20 @@ enum { idlen=16 };
 enum { maxsize=16384 };
 
 
-static void seed_randomizer(void)
+/* Fill buf with random bytes from the system; returns nonzero on success */
+static int get_random(void *buf, size_t len)
 {
-  srand(getpid()^time(NULL)^(unsigned long)getenv("SERVER_SOFTWARE"));
+  size_t done = 0;
+  const int fd = open("/dev/urandom", O_RDONLY);
+  if (fd == -1) return 0;
+  while (done < len)
+  {
+    const ssize_t bytes = read(fd, (char *)buf+done, len-done);
+    if (bytes > 0) done += bytes;
+    else if (bytes == 0 || errno != EINTR) break;
+  }
+  close(fd);
+  return done == len;
 }
 
 
@@ -74,16 +84,14 @@ static int read_id(const char input[], char buf[])
 }
 
 
-static void set_filename(char name[], const char gameid[])
-{
-  sprintf(name, "/var/local/lib/mines/games/%s", gameid);
-}
+/* All games live in one archive file, indexed by their ids */
+static const char archive_path[] = "/var/local/lib/mines/games.archive";
 
 
 int main(void)
 {
   char id[idlen*2];
-  char filename[300];
+  MinesArchive *archive = NULL;
   int rows=0, cols=0, mines=0, intelligence=mines_max_intelligence();
   int atr=0, atc=0, coords_set=0;
   Minefield *F = NULL;
@@ -138,44 +146,28 @@ int main(void)
     }
   }
 
-  if (id[0])
+  archive = mines_archive_open(archive_path, 1);
+  if (!archive)
   {
-    char saved[maxsize+1000];
-    int fd = -1;
-    ssize_t bytes = 0, bytesread = 0;
+    fprintf(stderr, "Could not open game archive %s\n", archive_path);
+    exit(1);
+  }
 
-    set_filename(filename, id);
-    fd = open(filename, O_RDONLY);
-    if (fd == -1)
-    {
-      const int err = errno;
-      perror("Could not open game file for reading");
-      if (err == EEXIST)
-      {
-        puts("<p><em>Game not found</em></p>");
-	puts(footer);
-      }
-      exit(1);
-    }
-    do
-    {
-      bytes = read(fd, saved+bytesread, sizeof(saved)-bytesread-1);
-      if (bytes > 0) bytesread += bytes;
-    } while (bytes > 0 || (bytes == -1 && errno == EINTR));
-    if (bytes < 0)
+  if (id[0])
+  {
+    F = mines_archive_load(archive, strtoull(id, NULL, 16));
+    if (!F)
     {
-      perror("Error reading game");
+      puts("<p><em>Game not found</em></p>");
+      puts(footer);
       exit(1);
     }
-    close(fd);
-    F = mines_load(saved);
-    if (!F) exit(1);
     rows = mines_rows(F);
     cols = mines_cols(F);
   }
   else if (rows && cols && mines)
   {
-    size_t idbytes = 0;
+    unsigned long long randomness[2];
 
     if (rows*cols > maxsize)
     {
@@ -192,14 +184,13 @@ int main(void)
     }
 
     /* We have parameters.  Create new game. */
-    seed_randomizer();
-    do
+    if (!get_random(randomness, sizeof(randomness)))
     {
-      sprintf(id+idbytes,"%*.*x",4,4,rand());
-      idbytes = strlen(id);
-    } while (idbytes < idlen);
-    id[idlen] = '\0';
-    F = mines_init(rows,cols,mines);
+      perror("Could not read random data");
+      exit(1);
+    }
+    sprintf(id, "%016llx", randomness[0]);
+    F = mines_init_seeded(rows,cols,mines,(unsigned long)randomness[1]);
     if (!F) exit(1);
     if (mines_savesize(F) > maxsize)
     {
@@ -220,9 +211,6 @@ int main(void)
     int r, c;
     int done=0;
     const char *scriptname = getenv("SCRIPT_NAME");
-    char saved[maxsize+100];
-    int fd;
-    size_t bytes;
     char url[200];
     size_t urlhead;
 
@@ -265,24 +253,15 @@ int main(void)
     }
     puts("</table></tt></form>");
 
-    bytes = mines_save(F,saved);
-    set_filename(filename, id);
-    fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0744);
-    if (fd == -1)
+    if (mines_archive_store(archive, strtoull(id, NULL, 16), F) != 0)
     {
-        perror("Could not open game file for writing");
-        exit(1);
-    }
-    if (write(fd, saved, bytes) < 0)
-    {
-        perror("Could not write game file");
-	unlink(filename);
-	exit(1);
+      fprintf(stderr, "Could not store game\n");
+      exit(1);
     }
-    close(fd);
     mines_close(F);
   }
 
+  mines_archive_close(archive);
   printf("%s", footer);
   return 0;
 }
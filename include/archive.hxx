@@ -0,0 +1,194 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#ifndef MINES_ARCHIVE_HXX
+#define MINES_ARCHIVE_HXX
+
+/** @addtogroup CXXAPI Native C++ API to libmines
+ */
+//@{
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "gamelogic.hxx"
+
+/// File holding any number of saved games, indexed by game identifier
+/** Keeping each saved game in a file of its own stops scaling somewhere around
+ * the millions of games: the directory becomes a burden for the filesystem.  A
+ * GameArchive keeps all of them in one file instead, with a hash index to look
+ * up games by their 64-bit identifiers.
+ *
+ * Each game lives in a slot of its own, sized to a power of two.  A slot holds
+ * two copies of its game, each with a sequence number and a checksum.  Storing
+ * a game overwrites the older copy in place, so if the program or the system
+ * crashes halfway through, the other copy is still there and loading falls
+ * back on it.  A game that outgrows its slot moves to a larger one; the old
+ * slot is recycled for other games.  The file's header is kept in duplicate in
+ * the same way.  This relies on small aligned writes (a 16-byte index entry)
+ * either happening completely or not at all, as disks normally guarantee.
+ *
+ * Space that is lost to a crash, or to a growing index, is reclaimed by
+ * compact(), which rewrites the archive to a new file and moves it into place.
+ *
+ * Any number of processes may use the same archive at the same time; they
+ * coordinate through file locks.  A GameArchive object is not thread-safe,
+ * but threads can each open their own.  The file is in the machine's native
+ * byte order, so it can't be moved between machines of different kinds.
+ */
+class GameArchive
+{
+public:
+  /// Open archive file, creating it if it does not exist
+  /** If durable is true, writes are flushed to disk in the right order for the
+   * archive to survive a system crash.  Without it, the archive still survives
+   * a crashing program, and writes are much faster.
+   */
+  explicit GameArchive(const std::string &path, bool durable=true);
+  ~GameArchive() throw ();
+
+  /// Load game with given id; returns null if there is none
+  /** The caller owns the returned Lake, and must delete it.
+   */
+  Lake *load(uint64_t id);
+  /// Read saved state of game with given id; returns false if there is none
+  /** The state is followed by a terminating zero, as written by save().
+   */
+  bool load(uint64_t id, std::vector<char> &state);
+
+  /// Store game under given id, adding it or replacing the stored version
+  void store(uint64_t id, const BasicLake &);
+  /// Store saved game state, as written by BasicLake::save()
+  void store(uint64_t id, const char state[], std::size_t length);
+  /// Store several saved games at once, mapped by their ids
+  /** Each game's state is as written by BasicLake::save(), without the
+   * terminating zero.  Replacing a game that still fits its slot needs only a
+   * single flush to disk, so in durable mode this is a lot faster than storing
+   * the games one by one: they can share that flush.
+   */
+  void store(const std::map<uint64_t, std::vector<char> > &games);
+
+  /// Delete game with given id; returns false if there was none
+  bool remove(uint64_t id);
+
+  /// Number of games in archive
+  uint64_t size();
+
+  /// Rewrite archive without any unused space
+  /** The archive is locked while this happens, so other users of the archive
+   * will have to wait.
+   */
+  void compact();
+
+private:
+  class Lock;
+  friend class Lock;
+
+  /// Slots come in sizes of 256 bytes times a power of two
+  enum { size_classes = 40 };
+
+  /// File header; the file starts with two copies of it
+  struct Superblock
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t padding;
+    /// Incremented on every write; the valid copy with highest number wins
+    uint64_t sequence;
+    /// File offset of hash index, and its number of buckets
+    uint64_t index, buckets;
+    /// Buckets in use, including those of deleted games
+    uint64_t used;
+    uint64_t games;
+    /// End of allocated space in file
+    uint64_t end;
+    /// Heads of lists of recycled slots, one per size class
+    uint64_t free[size_classes];
+    uint64_t checksum;
+  };
+
+  /// Open archive file, creating it if necessary
+  void open_file();
+  /// Lock archive file, reopening it first if it was replaced by compact()
+  void lock(bool exclusive);
+  void unlock() throw ();
+  /// Set up empty archive in newly created file
+  void initialize();
+  void read_super();
+  void write_super();
+  void sync();
+  /// Store game while holding lock; returns whether a flush is still needed
+  bool put(uint64_t id, const char data[], std::size_t length);
+
+  /// Find id in index; returns its bucket, or the bucket to insert it into
+  uint64_t find(uint64_t id, bool &found);
+  uint64_t bucket_offset(uint64_t bucket) const throw ();
+  /// Read valid copy of game in slot, with highest sequence number
+  /** Returns which of the slot's two copies that was.
+   */
+  int read_slot(uint64_t slot,
+	uint64_t id,
+	std::vector<char> &data,
+	uint64_t &sequence,
+	int &sizeclass);
+  /// Put game into newly allocated slot; returns the slot's file offset
+  uint64_t place(uint64_t id, const char data[], std::size_t length);
+  /// Take slot of given size class; caller must write superblock
+  uint64_t allocate(int sizeclass);
+  /// Recycle slot of given size class; caller must write superblock
+  void release(uint64_t slot, int sizeclass);
+  /// Replace index by a larger one, dropping deleted entries
+  void grow_index();
+
+  static void init_super(Superblock &, uint64_t buckets);
+  /// Write superblock to the older of the file's two copies
+  static void write_super(int fd, Superblock &);
+  /// Set up slot, with game as its only valid copy
+  static void init_slot(int fd,
+	uint64_t slot,
+	uint64_t id,
+	int sizeclass,
+	const char data[],
+	std::size_t length);
+  /// Write one of the two copies of a game in a slot
+  static void write_copy(int fd,
+	uint64_t slot,
+	uint64_t id,
+	int sizeclass,
+	int copy,
+	uint64_t sequence,
+	const char data[],
+	std::size_t length);
+
+  std::string m_path;
+  int m_fd;
+  bool m_durable;
+  /// Copy of file header, as read when the archive was last locked
+  Superblock m_super;
+
+  GameArchive(const GameArchive &);
+  const GameArchive &operator=(const GameArchive &);
+};
+
+//@}
+
+#endif
@@ -0,0 +1,159 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef MINES_BATCH_HXX
+#define MINES_BATCH_HXX
+
+/** @addtogroup CXXAPI Native C++ API to libmines
+ */
+//@{
+
+#include <stdint.h>
+#include <vector>
+
+#include "gamelogic.hxx"
+
+/// Many games of the same size, played in lockstep
+/** A simulator that plays millions of small games spends most of its time on
+ * the overhead of each single move, not on the move itself.  A LakeBatch plays
+ * a whole batch of boards at once instead.  Each move is made on all boards
+ * that are still being played, and boards that have been won or lost simply
+ * drop out.
+ *
+ * The boards are stored "sideways": for each patch, there is one bit per board
+ * saying whether it is mined, and one saying whether it has been revealed.  The
+ * same patch of 64 boards thus fits in a single machine word, and most of the
+ * game logic is done with bitwise operations on whole words, i.e. on 64 boards
+ * at a time.  Throughput is best measured in board-moves per second.
+ *
+ * Board number i gets the same mines as a Lake of the same size that was
+ * created with seed+i as its seed.  The batch plays by the classic rules: at
+ * intelligence level 1 (the default), revealing a patch with no mines around it
+ * also reveals its neighbours, and so on.  Lake's level 1 goes slightly further
+ * by also recognizing patches whose remaining neighbours must all be mines, so
+ * a batch can end up revealing fewer patches than a Lake would.  Intelligence
+ * levels above 1 act like level 1.  Only the square topology is supported, and
+ * only patches inside the playing field can be queried.
+ */
+class LakeBatch
+{
+public:
+  /// Set up given number of boards of given size; call reset() to play
+  LakeBatch(int boards, int rows, int cols);
+
+  /// Start new games on all boards
+  /** Throws std::invalid_argument if there are more mines than patches.
+   */
+  void reset(int mines, unsigned long seed);
+
+  /// Change intelligence level: 0 reveals only what's probed, 1 floods zeroes
+  void set_intelligence(int i) throw () { m_intelligence = i; }
+  /// Current intelligence level
+  int intelligence() const throw () { return m_intelligence; }
+
+  /// Number of boards in batch
+  int boards() const throw () { return m_boards; }
+  /// Number of rows on each board
+  int rows() const throw () { return m_rows; }
+  /// Number of columns on each board
+  int cols() const throw () { return m_cols; }
+
+  /// Number of boards that have been neither won nor lost yet
+  int playing() const throw ();
+  /// Is given board still being played?
+  bool playing(int board) const;
+  /// Has a mine gone off on given board?
+  bool lost(int board) const;
+  /// Has every clear patch on given board been revealed?
+  bool won(int board) const { return !playing(board) && !lost(board); }
+
+  /// Number of moves made on given board
+  int moves(int board) const;
+  /// Number of unmined patches on given board still to be revealed
+  int to_go(int board) const;
+
+  /// Status of patch on given board, as in BasicLake::status_at()
+  char status_at(int board, int row, int col) const;
+  /// Status of patch at given position on each of the boards
+  /** @param out receives boards() characters, as in status_at()
+   */
+  void status(int row, int col, char out[]) const;
+
+  /// Probe the same patch on every board still being played
+  /** Boards where the patch turns out to be mined are lost; boards where no
+   * clear patches remain are won.
+   */
+  void probe(int row, int col);
+  /// Make a different move on each board still being played
+  /** @param moves one position per board; ignored for boards not in play
+   */
+  void probe(const Coords moves[]);
+
+private:
+  /// One bit per board, for one patch of up to 64 boards
+  typedef uint64_t Lanes;
+  enum { lanebits = 64 };
+
+  int index_for(int row, int col) const throw ()
+	{ return (row+1)*(m_cols+2) + col + 1; }
+  Lanes *plane(std::vector<Lanes> &p, int index) throw ()
+	{ return &p[index*m_words]; }
+  const Lanes *plane(const std::vector<Lanes> &p, int index) const throw ()
+	{ return &p[index*m_words]; }
+  static Lanes bit(int board) throw ()
+	{ return Lanes(1) << (board % lanebits); }
+  void check_board(int board) const;
+  void check_pos(int row, int col) const;
+  /// Functor: place mine on one board, for reset()
+  class place_mine;
+
+  /// Reveal given patch on boards in mask, within word w of the planes
+  void reveal(int index, int w, Lanes mask) throw ();
+  /// Apply intelligence to boards in play, and retire finished boards
+  void settle() throw ();
+  /// Reveal neighbours of revealed, mine-free patches; true if anything changed
+  bool flood_pass(bool backwards) throw ();
+
+  int m_boards, m_rows, m_cols;
+  /// Number of words needed for one patch of all boards
+  int m_words;
+  int m_intelligence;
+
+  /// Per patch (including a one-patch border): which boards have it mined
+  std::vector<Lanes> m_mined;
+  /// Per patch: on which boards it has been revealed
+  std::vector<Lanes> m_revealed;
+  /// Per patch: on which boards it's clear, and so are all its neighbours
+  std::vector<Lanes> m_empty;
+  /// Per patch: on which boards its neighbours were revealed because it's empty
+  std::vector<Lanes> m_flooded;
+  /// Boards still being played, and boards that have been lost
+  std::vector<Lanes> m_playing, m_lost;
+  /// Moves made on each board
+  std::vector<int> m_moves;
+  /// Words of the bit planes that hold boards still in play
+  std::vector<int> m_active;
+
+  LakeBatch(const LakeBatch &);
+  const LakeBatch &operator=(const LakeBatch &);
+};
+
+//@}
+
+#endif
@@ -39,13 +39,362 @@ typedef void Minefield;
  *
  * Remember to initialize the randomizer by calling srand() with some random
  * input before starting a game, or you'll always get the same configuration.
+ *
+ * Thread safety: different threads may work on different Minefields at the
+ * same time, but not on the same one.  Functions that take no seed use rand(),
+ * which is not guaranteed to be thread-safe.
  */
 Minefield *mines_init(int rows, int cols, int mines);
 
+/** @brief Create minefield whose mine placement is determined by seed.
+ * Unlike mines_init(), this does not use the global randomizer, so it is safe
+ * to call from multiple threads.  Clean up with mines_close() later!
+ */
+Minefield *mines_init_seeded(int rows, int cols, int mines,
+	unsigned long seed);
+
+/** @brief Which patches count as each other's neighbours
+ */
+enum MinesTopology
+{
+  /** Classic Minesweeper: the eight patches around a square */
+  MINES_SQUARE,
+  /** Hexagonal patches, odd rows shifted half a patch to the right */
+  MINES_HEX,
+  /** Eight neighbours as in MINES_SQUARE, but the edges wrap around */
+  MINES_TORUS,
+  /** The eight patches a chess knight's move away */
+  MINES_KNIGHT
+};
+
+/** @brief Create seeded minefield with given topology
+ * Hints are only available for MINES_SQUARE.  A MINES_TORUS field must be at
+ * least 3 by 3 patches.  Clean up with mines_close() later!
+ * @param topology one of the MinesTopology values
+ * @return The new minefield, or NULL on error
+ */
+Minefield *mines_init_topology(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	int topology);
+
+/** @brief Minefield's topology, as one of the MinesTopology values
+ */
+int mines_topology(const Minefield *);
+
+/** @brief How a minefield is laid out in memory
+ * The layout makes no difference to the game, only to its speed.
+ */
+enum MinesLayout
+{
+  /** Row by row */
+  MINES_ROW_MAJOR,
+  /** In blocks of 8 by 8 patches, for very large fields; MINES_SQUARE only */
+  MINES_BLOCKED
+};
+
+/** @brief Create seeded square minefield with given memory layout
+ * Clean up with mines_close() later!
+ * @param layout one of the MinesLayout values
+ * @return The new minefield, or NULL on error
+ */
+Minefield *mines_init_layout(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	int layout);
+
+/** @brief Create huge minefield, generated in tiles by the given threads
+ * Uses one thread per core if threads is zero.  The result depends only on
+ * the seed, but differs from what mines_init_seeded() makes.  See the C++
+ * function Lake::reset_tiled() for details.  Clean up with mines_close()
+ * later!
+ * @return The new minefield, or NULL on error
+ */
+Minefield *mines_init_tiled(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	int threads);
+
+/** @brief Create minefield that can be won without guessing.
+ * Clicking the given first patch, and letting the given level of intelligence
+ * propagate, will reveal every clear patch.  The game's intelligence level is
+ * set accordingly.  The search for a suitable board is spread out over the
+ * given number of threads, or one per core if threads is zero; the result
+ * depends only on the seed.  Clean up with mines_close() later!
+ * @return The new minefield, or NULL if no such board could be found
+ */
+Minefield *mines_init_solvable(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	int first_row,
+	int first_col,
+	int intelligence,
+	int threads);
+
 /** @brief Reload game state from memory buffer filled by mines_save()
  */
 Minefield *mines_load(const char buffer[]);
 
+/** @brief Type used to refer to a recycling allocator for Minefields.
+ * A pool keeps the memory of closed games around for reuse by new ones, which
+ * saves a lot of work in programs that run through many short games.  A pool
+ * is not thread-safe; give each thread its own.
+ */
+typedef void MinesPool;
+
+/** @brief Create pool.  Clean up with mines_pool_destroy() later!
+ * @return The new pool, or NULL on error
+ */
+MinesPool *mines_pool_create(void);
+
+/** @brief Destroy pool created with mines_pool_create()
+ * All of the pool's Minefields must have been closed first.
+ */
+void mines_pool_destroy(MinesPool *);
+
+/** @brief Create minefield in pool.  Clean up with mines_pool_close() later!
+ * @return The new minefield, or NULL on error
+ */
+Minefield *mines_pool_init(MinesPool *, int rows, int cols, int mines);
+
+/** @brief Create seeded minefield in pool; see mines_init_seeded()
+ * @return The new minefield, or NULL on error
+ */
+Minefield *mines_pool_init_seeded(MinesPool *,
+	int rows,
+	int cols,
+	int mines,
+	unsigned long seed);
+
+/** @brief Reload game state into pool.  Clean up with mines_pool_close()!
+ * @return The reloaded minefield, or NULL on error
+ */
+Minefield *mines_pool_load(MinesPool *, const char buffer[]);
+
+/** @brief Close minefield created in pool, recycling its memory
+ * Never use mines_close() on a minefield created in a pool, or vice versa.
+ */
+void mines_pool_close(MinesPool *, Minefield *);
+
+/** @brief Start a new game in an existing minefield, reusing its memory
+ * @return 0 on success, or -1 on error
+ */
+int mines_reset(Minefield *, int rows, int cols, int mines);
+
+/** @brief Start a new seeded game in an existing minefield
+ * @return 0 on success, or -1 on error
+ */
+int mines_reset_seeded(Minefield *, int rows, int cols, int mines,
+	unsigned long seed);
+
+/** @brief Type used to refer to a thread-safe table of running games.
+ * Games are identified by 64-bit numbers of your choosing.  Threads can work
+ * on different games in the same table concurrently.
+ */
+typedef void MinesTable;
+
+/** @brief Create game table.  Clean up with mines_table_destroy() later!
+ * @param shards Number of independently locked parts; more means less
+ * contention between threads
+ * @return The new table, or NULL on error
+ */
+MinesTable *mines_table_create(int shards);
+
+/** @brief Destroy table, closing any games still in it
+ */
+void mines_table_destroy(MinesTable *);
+
+/** @brief Add game created with mines_init() or mines_load() to table.
+ * The table takes ownership of the minefield.
+ * @return 1 on success, 0 if id already in use (minefield not added), or -1
+ * on error
+ */
+int mines_table_insert(MinesTable *, unsigned long long id, Minefield *);
+
+/** @brief Take game out of table, returning ownership to caller
+ * @return The minefield, or NULL if there was no game with that id
+ */
+Minefield *mines_table_remove(MinesTable *, unsigned long long id);
+
+/** @brief Like mines_probe(), but on the game with given id in table
+ * @return Boolean: correctness of guess (or -1 on error, including when there
+ * is no game with that id)
+ */
+int mines_table_probe(MinesTable *,
+	unsigned long long id,
+	int row,
+	int col,
+	int minedP);
+
+/** @brief Type used to refer to a batch of same-sized games played in lockstep.
+ * Each move is made on all boards in the batch at once, which is much faster
+ * than playing them one by one.  Board i gets the same mines as a game created
+ * with mines_init_seeded() using seed+i.  Batches only flood empty patches, as
+ * at intelligence level 1; see the C++ class LakeBatch for details.
+ */
+typedef void MinesBatch;
+
+/** @brief Create batch.  Start games with mines_batch_reset()!
+ * Clean up with mines_batch_destroy() later.
+ * @return The new batch, or NULL on error
+ */
+MinesBatch *mines_batch_create(int boards, int rows, int cols);
+
+/** @brief Destroy batch created with mines_batch_create()
+ */
+void mines_batch_destroy(MinesBatch *);
+
+/** @brief Start new games on all boards in batch
+ * @return 0 on success, or -1 on error
+ */
+int mines_batch_reset(MinesBatch *, int mines, unsigned long seed);
+
+/** @brief Probe the same patch on all boards still in play
+ * @return Number of boards still in play afterwards, or -1 on error
+ */
+int mines_batch_probe_all(MinesBatch *, int row, int col);
+
+/** @brief Probe a different patch on each board still in play
+ * @param rows one row per board in batch
+ * @param cols one column per board in batch
+ * @return Number of boards still in play afterwards, or -1 on error
+ */
+int mines_batch_probe(MinesBatch *, const int rows[], const int cols[]);
+
+/** @brief State of one board in batch
+ * @return 0 if still in play, 1 if won, 2 if lost, or -1 on error
+ */
+int mines_batch_state(const MinesBatch *, int board);
+
+/** @brief Status of patch on one board in batch, as with mines_at()
+ * @return Status character, or 0 on error
+ */
+char mines_batch_at(const MinesBatch *, int board, int row, int col);
+
+/** @brief Type used to refer to a file holding many saved games.
+ * Games in an archive are identified by 64-bit numbers of your choosing.  Any
+ * number of processes can use the same archive file at the same time.
+ */
+typedef void MinesArchive;
+
+/** @brief Open archive file, creating it if needed.  Close with
+ * mines_archive_close() later!
+ * @param durable If nonzero, flush every change to disk so the archive
+ * survives a system crash (it always survives a crashing program)
+ * @return The archive, or NULL on error
+ */
+MinesArchive *mines_archive_open(const char path[], int durable);
+
+/** @brief Close archive opened with mines_archive_open()
+ */
+void mines_archive_close(MinesArchive *);
+
+/** @brief Load game with given id from archive.  Clean up with mines_close()!
+ * @return The game, or NULL if there is none (or on error)
+ */
+Minefield *mines_archive_load(MinesArchive *, unsigned long long id);
+
+/** @brief Store game in archive under given id, replacing any earlier version
+ * @return 0 on success, or -1 on error
+ */
+int mines_archive_store(MinesArchive *, unsigned long long id,
+	const Minefield *);
+
+/** @brief Delete game with given id from archive
+ * @return 1 if the game was deleted, 0 if there was none, or -1 on error
+ */
+int mines_archive_remove(MinesArchive *, unsigned long long id);
+
+/** @brief Number of games in archive
+ * @return Number of games, or -1 on error
+ */
+long long mines_archive_size(MinesArchive *);
+
+/** @brief Rewrite archive file to reclaim unused space
+ * @return 0 on success, or -1 on error
+ */
+int mines_archive_compact(MinesArchive *);
+
+/** @brief Type used to refer to a write-behind queue of games to be stored.
+ * A background thread stores queued games in an archive.  A game that is queued
+ * again before it was written is only written once, in its latest state.
+ */
+typedef void MinesSaveQueue;
+
+/** @brief Open archive for write-behind storage, as with mines_archive_open().
+ * Close with mines_queue_close() later!
+ * @return The queue, or NULL on error
+ */
+MinesSaveQueue *mines_queue_open(const char path[], int durable);
+
+/** @brief Store any games still queued, and close queue
+ */
+void mines_queue_close(MinesSaveQueue *);
+
+/** @brief Queue game to be stored under given id.  Returns without waiting.
+ * @return 0 on success, or -1 on error
+ */
+int mines_queue_store(MinesSaveQueue *, unsigned long long id,
+	const Minefield *);
+
+/** @brief Wait until all games queued so far have been stored
+ * @return 0 on success, or -1 if games could not be stored
+ */
+int mines_queue_flush(MinesSaveQueue *);
+
+/** @brief Type used to refer to a log of moves made in a game.
+ * A log records a game's starting state and every move made in it, so that
+ * the game can be replayed exactly later.
+ */
+typedef void MinesLog;
+
+/** @brief Start recording moves made in game.  Clean up with mines_log_close()!
+ * Recording stops when mines_log_stop() is called, or when a new game is
+ * started in the minefield.  The log must not be closed before that.
+ * @param checkpoint_interval Record a fingerprint of the game's state every
+ * this many moves, to be checked on replay; 0 for none
+ * @return The new log, or NULL on error
+ */
+MinesLog *mines_log_start(Minefield *, int checkpoint_interval);
+
+/** @brief Stop recording moves made in game
+ */
+void mines_log_stop(Minefield *);
+
+/** @brief Clean up log created by mines_log_start() or mines_log_load()
+ */
+void mines_log_close(MinesLog *);
+
+/** @brief Number of moves recorded in log
+ */
+int mines_log_moves(const MinesLog *);
+
+/** @brief Maximum number of bytes of storage required to save log
+ */
+int mines_log_savesize(const MinesLog *);
+
+/** @brief Save log to buffer (at least mines_log_savesize() large)
+ * @return Number of bytes of buffer space used (not including terminating zero)
+ */
+int mines_log_save(const MinesLog *, char buffer[]);
+
+/** @brief Reload log from memory buffer filled by mines_log_save()
+ * @return The log, or NULL on error.  Clean up with mines_log_close() later!
+ */
+MinesLog *mines_log_load(const char buffer[]);
+
+/** @brief Reconstruct recorded game, and replay its moves at full speed
+ * @param verify If nonzero, check that every move and checkpoint comes out
+ * exactly as recorded
+ * @return The game in its final state, or NULL on error (including any
+ * difference found while verifying).  Clean up with mines_close() later!
+ */
+Minefield *mines_replay(const MinesLog *, int verify);
+
 /** @brief Maximum number of bytes of storage required to save game
  */
 int mines_savesize(const Minefield *);
@@ -63,6 +412,14 @@ int mines_max_intelligence(void);
  */
 void mines_set_intelligence(Minefield *, int);
 
+/** @brief Label the openings in advance (nonzero), or stop doing so (zero)
+ *
+ * Speeds up probing patches with no mines around them on large fields.  See
+ * the C++ function BasicLake::index_openings() for details.  Returns zero on
+ * success, or -1 if there was not enough memory.
+ */
+int mines_index_openings(Minefield *, int);
+
 /** @brief Clean up minefield created with mines_init()
  */
 void mines_close(Minefield *);
@@ -72,6 +429,14 @@ void mines_close(Minefield *);
  */
 int mines_probe(Minefield *, int row, int col, int minedP);
 
+/** @brief Reveal everything that has become obvious, all over the field
+ *
+ * Does what intelligence level 2 would, for the whole playing field at once.
+ * See the C++ function BasicLake::solve_obvious() for details.
+ * @return Number of patches revealed (or -1 on error)
+ */
+int mines_solve_obvious(Minefield *);
+
 /** Number of moves made
  */
 int mines_moves(const Minefield *);
@@ -82,6 +447,65 @@ int mines_moves(const Minefield *);
  */
 char mines_at(const Minefield *, int row, int col);
 
+/** @brief Suggest next patch to probe as clear
+ * Picks a patch known to be clear if possible, or else the least risky guess.
+ * The analysis is cached and updated incrementally as the game progresses, so
+ * this is cheap to call after every move.
+ * @param row receives suggested patch's row
+ * @param col receives suggested patch's column
+ * @return 1 if the patch is known to be clear, 0 if it's a guess, or -1 if
+ * there is nothing left to explore (or on error)
+ */
+int mines_hint(Minefield *, int *row, int *col);
+
+/** @brief Measure how difficult the playing field is, judging by its mines
+ * An opening is a connected area of patches with no mines around them; probing
+ * one reveals all of it, and the numbers on its edge.  Numbers not on the edge
+ * of any opening are isolated.  The minimum number of probes needed to clear
+ * the field, known as "3BV," is the number of openings plus isolated numbers.
+ * Only the mines count, not what has been revealed.  Takes one pass over the
+ * playing field.
+ * @param openings if not NULL, receives the number of openings
+ * @param isolated if not NULL, receives the number of isolated numbers
+ * @param sizes if not NULL, receives the number of patches revealed by each
+ * opening (at most max_sizes of them), in order of their first patches
+ * @return 3BV, or -1 on error
+ */
+int mines_metrics(const Minefield *,
+	int *openings,
+	int *isolated,
+	int sizes[],
+	int max_sizes);
+
+/** @brief Number of revealed numbers bordering on unexplored patches
+ * The frontier is maintained incrementally as the game progresses, so it's
+ * cheap to query after every move.  It includes the numbers shown just
+ * outside the playing field.
+ */
+int mines_frontier_numbers(const Minefield *);
+
+/** @brief Number of unexplored patches bordering on revealed numbers
+ */
+int mines_frontier_unknowns(const Minefield *);
+
+/** @brief Position of a number on the frontier
+ * The frontier is kept in no particular order, and the order changes with
+ * every move.
+ * @param i index of the number, 0 <= i < mines_frontier_numbers()
+ * @param row receives the number's row
+ * @param col receives the number's column
+ * @return 0 on success, or -1 if i is out of range
+ */
+int mines_frontier_number(const Minefield *, int i, int *row, int *col);
+
+/** @brief Position of an unexplored patch on the frontier
+ * @param i index of the patch, 0 <= i < mines_frontier_unknowns()
+ * @param row receives the patch's row
+ * @param col receives the patch's column
+ * @return 0 on success, or -1 if i is out of range
+ */
+int mines_frontier_unknown(const Minefield *, int i, int *row, int *col);
+
 /** @brief Number of unmined fields still left to be uncovered
  */
 int mines_togo(const Minefield *);
@@ -17,11 +17,20 @@ libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
 Suite 330, Boston, MA  02111-1307  USA
 */
 
+#ifndef MINES_GAMELOGIC_HXX
+#define MINES_GAMELOGIC_HXX
+
 /** @addtogroup CXXAPI Native C++ API to libmines
  */
 //@{
 
+#include <cassert>
+#include <cstddef>
+#include <exception>
 #include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
 
 /// Coordinates of a patch of sea
 struct Coords
@@ -57,44 +66,214 @@ struct Boom
 };
 
 
-class Patch;
+/// Suggested next move, as produced by BasicLake::hint()
+struct Hint
+{
+  /// Coordinates of suggested patch to probe as clear
+  Coords position;
+  /// Is the patch known to be clear?  If not, it's the least risky guess.
+  bool safe;
+  /// Estimated probability that the patch is mined (zero if safe)
+  double risk;
 
-/// The "minefield."  This is where it all happens.
-/** The Lake is a rectangle of square Patches, each of which may or may not have
- * a mine in it.  In the internal representation, the Lake is surrounded by a
- * border of clear Patches, which are not shown.  This means there are fewer
- * special cases in the algorithm for border Patches.  They do complicate the
- * array indexing and such, but all that is nicely hidden here.
- *
- * Remember to initialize the randomizer by calling srand() with some random
- * input before starting a game, or you'll always get the same configuration.
+  Hint() : position(0,0), safe(false), risk(0) {}
+};
+
+
+/// Difficulty measures of a playing field's layout of mines
+/** An opening is a connected area of clear patches that have no mines around
+ * them.  Probing any patch in an opening reveals all of it, plus the numbers
+ * along its edge.  A number that is not on the edge of any opening has to be
+ * probed by itself; that makes it an isolated number.
  */
-class Lake
+struct BoardMetrics
+{
+  /// Minimum number of probes needed to clear the field, known as "3BV"
+  int bbbv;
+  /// Number of openings
+  int openings;
+  /// Number of isolated numbers
+  int isolated;
+  /// Number of patches each opening reveals, including the numbers on its edge
+  /** Openings are listed in the order of their first patches, row by row.
+   */
+  std::vector<int> opening_sizes;
+
+  BoardMetrics() : bbbv(0), openings(0), isolated(0), opening_sizes() {}
+};
+
+
+/// Which patches count as each other's neighbours
+/** The values are the same as those of MinesTopology in the C API.
+ */
+enum Topology
+{
+  /// Classic Minesweeper: the eight patches around a square
+  square_topology,
+  /// Hexagonal patches, odd rows shifted half a patch to the right
+  hex_topology,
+  /// Eight neighbours like square_topology, but the edges wrap around
+  torus_topology,
+  /// The eight patches a chess knight's move away
+  knight_topology
+};
+
+
+/// How a Lake lays out its playing field in memory
+/** The values are the same as those of MinesLayout in the C API.
+ */
+enum Layout
+{
+  /// Row by row; the default
+  row_major_layout,
+  /// In blocks of 8 by 8 patches, so a patch's neighbours are mostly close by
+  /** On very wide fields, the rows above and below a patch are far away in
+   * memory in row_major_layout, and every look at a patch's neighbourhood
+   * touches three cache lines and often as many pages.  This layout keeps most
+   * neighbourhoods within a single block.  Only square_topology can use it.
+   */
+  blocked_layout
+};
+
+
+class HintCache;
+class LakePool;
+class MoveLog;
+struct BlankField;
+struct OpeningIndex;
+
+
+/// A square patch of water, which may or may not contain a mine
+/** This is an implementation detail of the Lake classes.  It is only defined
+ * here so that a FixedLake can hold its playing field inline.
+ */
+class Patch
 {
 public:
-  /// Start new game
-  Lake(int rows, int cols, int mines);
-  /// Start game from saved game state
-  explicit Lake(const char[]);
+  explicit Patch(int neighbours=8) :
+    m_nearmines(0),
+    m_near_hiddenmines(0),
+    m_near_unknown(neighbours),
+    m_slot(-1),
+    m_mined(false),
+    m_revealed(false)
+  {
+  }
 
-  ~Lake() throw ();
+  /// Initialization: set a mine
+  void mine()
+  {
+    assert(!mined());
+    m_mined = true;
+  }
 
+  /// Remove mine again, e.g. to move it elsewhere
+  void unmine()
+  {
+    assert(mined());
+    assert(!revealed());
+    m_mined = false;
+  }
+
+  bool mined() const throw () { return m_mined; }
+  bool revealed() const throw () { return m_revealed; }
+  int near_mines() const throw () { return m_nearmines; }
+  int near_hiddenmines() const throw () { return m_near_hiddenmines; }
+  int near_unknown() const throw () { return m_near_unknown; }
+
+  void reveal() throw () { m_revealed = true; }
+
+  /// Position in the frontier index, or -1 if not on the frontier
+  int slot() const throw () { return m_slot; }
+  void set_slot(int s) throw () { m_slot = s; }
+
+  /// Initialization: mark the fact that a mine has been set in a nearby Patch
+  void set_nearby_mine()
+  {
+    ++m_nearmines;
+    ++m_near_hiddenmines;
+    assert(m_nearmines <= 8);
+    assert(m_near_hiddenmines <= m_nearmines);
+  }
+
+  /// Loading: account for a nearby Patch's final state in one go
+  /** Has the same effect as set_nearby_mine() if is_mined, followed by
+   * reveal_nearby(is_mined) if is_revealed, but without the checks.
+   */
+  void load_nearby(bool is_mined, bool is_revealed) throw ()
+  {
+    m_nearmines += is_mined;
+    m_near_hiddenmines += is_mined & !is_revealed;
+    m_near_unknown -= is_revealed;
+  }
+
+  /// Undo set_nearby_mine() for a nearby mine that has not been revealed
+  void unset_nearby_mine()
+  {
+    --m_nearmines;
+    --m_near_hiddenmines;
+    assert(m_near_hiddenmines >= 0);
+  }
+
+  /// Adjust to revelation of nearby Patch (mined or not, depending on argument)
+  /** Returns true if this made the Patch obvious().
+   */
+  bool reveal_nearby(bool is_mined)
+  {
+    const bool was_obvious = obvious();
+    m_near_hiddenmines -= is_mined;
+    --m_near_unknown;
+
+    assert(m_near_hiddenmines >= 0);
+    assert(m_near_unknown >= 0);
+    assert(m_near_hiddenmines <= m_near_unknown);
+    return !was_obvious && obvious();
+  }
+
+  /// Should the state of all nearby Patches now be obvious to the user?
+  bool obvious() const throw ()
+  {
+    return near_unknown() && revealed() && !mined() &&
+      (!near_hiddenmines() || near_hiddenmines()==near_unknown());
+  }
+
+private:
+  int m_nearmines;
+  int m_near_hiddenmines;
+  /// Nearby unrevealed patches (not correct for border patches, but who cares)
+  int m_near_unknown;
+  int m_slot;
+  bool m_mined;
+  bool m_revealed;
+};
+
+
+/// State and logic shared by all kinds of minefield
+/** The playing field is a rectangle of square Patches, each of which may or may
+ * not have a mine in it.  In the internal representation, the field is
+ * surrounded by a border of clear Patches, which are not shown.  This means
+ * there are fewer special cases in the algorithm for border Patches.  They do
+ * complicate the array indexing and such, but all that is nicely hidden here.
+ *
+ * The game logic itself is written in terms of a "grid" type that knows the
+ * field's dimensions.  For a Lake that is only known at runtime, but a
+ * FixedLake knows it at compile time, so the compiler can turn all of its index
+ * arithmetic into constants.  The grid also determines the field's Topology,
+ * i.e. which patches are neighbours, so the game logic is compiled separately
+ * for each topology and never needs to stop and ask.
+ *
+ * Don't use BasicLake directly; use Lake or FixedLake.
+ */
+class BasicLake
+{
+public:
   /// Maximum intelligence level available
   static int max_intelligence() throw () { return 2; }
 
   /// Change intelligence level
   void set_intelligence(int i) throw () { m_intelligence = i; }
-
-  /// Mark given patch as being either clear or mined
-  /** The specified amount of "intelligence" is recursively applied in revealing
-   * surrounding patches whose state becomes obvious.  Boom is thrown if the
-   * given patch is actually mined.
-   * @param row "y coordinate" of field
-   * @param col "x coordinate" of field
-   * @param changes will receive a list of all patches revealed by this move
-   * @param as_mine indicates whether user thinks this patch is mined
-   */
-  void probe(int row, int col, std::set<Coords> &changes, bool as_mine=false);
+  /// Current intelligence level
+  int intelligence() const throw () { return m_intelligence; }
 
   /// Number of unmined patches still to be revealed
   int to_go() const throw () { return m_patches_to_go; }
@@ -113,52 +292,207 @@ public:
   char status_at(int row, int col) const;
 
   /// Number of rows making up this Lake
-  const int rows() const throw () { return m_rows; }
+  int rows() const throw () { return m_rows; }
   /// Number of columns making up this Lake
-  const int cols() const throw () { return m_cols; }
+  int cols() const throw () { return m_cols; }
+  /// Which patches are each other's neighbours
+  Topology topology() const throw () { return m_topology; }
+  /// How the playing field is laid out in memory
+  Layout layout() const throw () { return m_layout; }
 
   /// Maximum number of bytes required to save this game
+  /** This depends on the state of the game, not just on its size: save() picks
+   * whichever of its formats is most compact.  Working that out takes a pass
+   * over the playing field.
+   */
   int savesize() const throw ();
 
   /// Write game state (in ASCII) to memory buffer
-  /** The available buffer space must be at least rows*cols+100 bytes large.
+  /** The available buffer space must be at least savesize() bytes large.
+   *
+   * There are two formats.  The dense one takes two bits per patch.  The
+   * sparse one lists the positions of the mines, and the runs of revealed
+   * patches, which is much smaller for games that have few mines or have only
+   * just started.  Either can be loaded again.
    */
   int save(char buf[]) const;
 
-private:
+  /// Number of revealed numbers that still have unexplored neighbours
+  /** Together with frontier_unknowns(), this describes the "frontier": the
+   * edge of the explored area, where all the interesting reasoning happens.
+   * The frontier is maintained as the game progresses, at constant cost per
+   * revealed patch, so algorithms can work on it without scanning the whole
+   * playing field.
+   *
+   * The numbers just outside the playing field count as well, since they are
+   * shown to the player.
+   */
+  int frontier_numbers() const throw () { return m_frontier_numbers; }
+  /// Number of unexplored patches next to a revealed number
+  int frontier_unknowns() const throw () { return m_frontier_unknowns; }
+  /// Position of a number on the frontier, for 0 <= i < frontier_numbers()
+  /** The frontier is kept in no particular order, and the order changes
+   * whenever the frontier does.
+   */
+  Coords frontier_number(int i) const;
+  /// Position of unexplored patch on frontier, 0 <= i < frontier_unknowns()
+  /** The frontier is kept in no particular order, and the order changes
+   * whenever the frontier does.
+   */
+  Coords frontier_unknown(int i) const;
+
+  /// Suggest the next patch to probe
+  /** Picks a patch that is known to be clear if there is one, or otherwise the
+   * unexplored patch that seems least likely to be mined.  A patch is "known"
+   * to be clear if that follows from a single number, or from comparing two
+   * numbers whose unexplored neighbours overlap.  Patches known to be mined are
+   * never suggested.
+   *
+   * The first call does a pass over the whole playing field.  After that the
+   * analysis is cached, and each probe only updates it around the patches that
+   * changed, so asking for a hint after every move stays cheap even on huge
+   * playing fields.
+   *
+   * Returns false if there is nothing left to explore.  Hints are only
+   * available in square_topology; other topologies throw std::logic_error.
+   */
+  bool hint(Hint &);
+
+  /// Measure how difficult the playing field is, judging by its mines
+  /** Only the layout of the mines counts, not what has been revealed so far.
+   * This takes a single pass over the playing field, joining up openings in a
+   * union-find structure, so it's cheap enough to run on every board a
+   * generator comes up with.
+   */
+  void metrics(BoardMetrics &) const;
+
+  /// Label the playing field's openings in advance, or stop doing so
+  /** With the openings labelled, probing a patch that has no mines around it
+   * reveals its whole opening, plus the numbers along its edge, in one sweep
+   * over a precomputed list of row spans, instead of discovering it one wave
+   * of neighbours at a time.  On large fields with few mines, that is most of
+   * the work of a game.  The labels are worked out once for each new game,
+   * using the same union-find pass as metrics(), and cost an int per patch.
+   *
+   * This only takes effect at intelligence level 2 and up, and only for
+   * openings that have not been partly revealed.  The outcome is exactly the
+   * same as without the labels, so the setting changes only how fast a game
+   * plays, not how it plays.  Level 1 checks whether a number's unexplored
+   * neighbours are obviously mines as the number is revealed, so what it finds
+   * depends on the order in which things get uncovered; revealing an opening
+   * all at once would change that, so level 1 does without the labels.
+   */
+  void index_openings(bool);
+  /// Are this game's openings labelled in advance?
+  bool openings_indexed() const throw () { return m_openings != 0; }
+
+  /// Reveal everything that has become obvious, all over the playing field
+  /** Applies the rule of intelligence level 2 to every revealed patch, over and
+   * over, until there is nothing obvious left.  That is what propagate() would
+   * get to if it looked at the whole field, whatever level the game was played
+   * at.  Useful after loading a game, or as an "auto-complete" button.  It
+   * does not count as a move.
+   *
+   * In square_topology this works on planes of bits, 64 patches to a machine
+   * word, rather than one patch at a time; other topologies go patch by patch.
+   * A recording in progress (see record()) starts over from the new state.
+   * @param changes will receive a list of all patches revealed
+   */
+  void solve_obvious(std::set<Coords> &changes);
+
+  /// Start recording moves in given log, or stop recording if it is null
+  /** The log starts out with a snapshot of the game's current state.  It must
+   * stay around for as long as the recording lasts.  Starting a new game in
+   * the same object ends the recording.
+   */
+  void record(MoveLog *);
+
+  /// Fingerprint of the game's state: mines, revealed patches, and moves made
+  /** Two games with the same fingerprint are all but certain to be in the same
+   * state.  The fingerprint is kept up to date as the game changes, so asking
+   * for it costs next to nothing.
+   */
+  uint64_t digest() const throw ();
+
   enum { border = 3 };
-  void init_field();
-  Patch &at(int row, int col);
-  const Patch &at(int row, int col) const;
 
-  bool place_mine_at(int row, int col);
+protected:
+  BasicLake(int rows, int cols, int intelligence, Topology=square_topology);
+  ~BasicLake() throw ();
 
-  /// Apply functor f to a square of Patches centered at (row,col)
-  /** The INCLUDECENTER template argument determines whether the central patch
-   * should be included in this square, or whether it should be skipped.
+  /// Exchange entire game state, including playing field storage pointers
+  /** Hints are dropped on both sides; they're worked out again when needed.
    */
-  template<int RADIUS, bool INCLUDECENTER, typename FUNCT>
-  void for_zone(int row, int col, FUNCT f)
+  void swap_state(BasicLake &) throw ();
+
+  /// Number of Patches in a playing field of given size, including border
+  static int arraysize(int rows, int cols) throw ()
+	{ return (rows+2*border)*(cols+2*border); }
+  /// Number of Patches in a field of given size and layout, with any padding
+  static int arraysize(int rows, int cols, Layout layout) throw ()
   {
-    const int top = std::max(-border, row-RADIUS),
-	      bottom = std::min(row+RADIUS+1, m_rows+border),
-	      left = std::max(-border, col-RADIUS),
-	      right = std::min(col+RADIUS+1, m_cols+border);
-
-    for (int r = top; r < bottom; ++r) for (int c = left; c < right; ++c)
-      if (INCLUDECENTER || r!=row || c!=col)
-        f(Coords(r,c),at(r,c));
+    return layout == row_major_layout ? arraysize(rows, cols) :
+	(rows+2*border+7)/8 * ((cols+2*border+7)/8) * 64;
   }
 
-  template<typename FUNCT> void for_neighbours(int row, int col, FUNCT f)
-	{ return for_zone<1,false>(row,col,f); }
-
-  void reveal_patch(int row, int col);
-
-  /// Initialize a row of patches in the lake's border
-  void border_row(int);
-  /// Initialize a row of patches in the lake's border
-  void border_col(int);
+  /// Set up fresh playing field in m_patches (which must be allocated)
+  /** The border comes out the same every time.  A Lake that gets reset notes
+   * what it looks like in m_blank, so a new game with the same dimensions can
+   * just copy it back in.  Without m_blank, the border is built from scratch.
+   */
+  template<typename GRID> void init_field(const GRID &);
+  /// Reset game state and fill m_patches with unexplored, clear patches
+  template<typename GRID> void clear_field(const GRID &);
+  /// Reveal the border around the field, or if quietly, just mark it revealed
+  template<typename GRID> void reveal_border(const GRID &, bool quietly);
+  /// Note what init_field() did to the field, in m_blank (if allocated)
+  template<typename GRID> void remember_blank(const GRID &) throw ();
+  /// Start new game on current field dimensions
+  template<typename GRID> void new_game(const GRID &, int mines,
+	unsigned long seed);
+  /// Read saved game's data block; header must already have been read
+  template<typename GRID> void load_field(const GRID &,
+	const char *data,
+	bool sparse);
+  /// Read dense data block, only marking patches as mined and revealed
+  template<typename GRID> const char *read_dense(const GRID &, const char *);
+  /// Read sparse data block, only marking patches as mined and revealed
+  template<typename GRID> const char *read_sparse(const GRID &, const char *);
+  /// Update counters and digest for everything read_dense/read_sparse marked
+  template<typename GRID> void count_loaded(const GRID &);
+  /// Set up frontier index, which must be empty, for the state of the field
+  template<typename GRID> void build_frontier(const GRID &);
+  /// Feed gaps between mines, in row-major order, to f
+  template<typename FUNCT> void sparse_mines(FUNCT &f) const;
+  /// Feed gap before, and length minus one of, each revealed run to f
+  template<typename FUNCT> void sparse_reveals(FUNCT &f) const;
+  template<typename GRID> void place_mines(const GRID &, int mines);
+  /// Functor: place mine, for place_mines()
+  template<typename GRID> class place_mine;
+  template<typename GRID> bool place_mine_at(const GRID &, int row, int col);
+  /// Move mine to another unexplored patch
+  template<typename GRID> void move_mine(const GRID &, Coords from, Coords to);
+  template<typename GRID> void reveal_patch(const GRID &, int row, int col);
+  template<typename GRID> void measure(const GRID &, BoardMetrics &) const;
+  /// Number each patch's opening in labels, or -1; returns number of openings
+  template<typename GRID> int label_openings(const GRID &,
+	std::vector<int> &labels) const;
+  /// Work out m_openings for the current playing field
+  template<typename GRID> void build_openings(const GRID &);
+  /// Reveal zero patch's opening in bulk, leaving its edge to propagate()
+  /** Returns false, without changing anything, if the opening can't be
+   * revealed in bulk.
+   */
+  template<typename GRID> bool reveal_opening(const GRID &,
+	int row,
+	int col,
+	std::set<Coords> &work,
+	std::set<Coords> &changes);
+  template<typename GRID> void probe(const GRID &,
+	int row,
+	int col,
+	std::set<Coords> &changes,
+	bool as_mine);
 
   /// Recursively reveal any patches whose status becomes or has become obvious
   /** This is where the intelligence level is applied in order to expose patches
@@ -173,24 +507,476 @@ private:
    *
    * Higher intelligence levels are accepted, but do not instill any greater
    * intelligence than is implemented.  More levels will be added in the future.
+   *
+   * At level 2, patches are noted in m_obvious as they become obvious, so only
+   * those need looking at.  If m_obvious can't be relied on, this falls back on
+   * searching the area around each patch it reveals.
+   */
+  template<typename GRID> void propagate(const GRID &,
+	std::set<Coords> &work,
+	std::set<Coords> &changes);
+  /// Reveal everything obvious, patch by patch, at level 2
+  template<typename GRID> void solve_cells(const GRID &,
+	std::set<Coords> &changes);
+  /// Reveal given patches, without propagating
+  template<typename GRID> void reveal_all(const GRID &,
+	const std::set<Coords> &);
+
+  /// Tell hint cache, if any, which patches were just revealed
+  void update_hints(const std::set<Coords> &) throw ();
+  /// Forget about hints, e.g. because we're starting a new game
+  void drop_hints() throw ();
+
+  /// Note that patch has become obvious, or that m_obvious is incomplete
+  void note_obvious(Coords) throw ();
+  /// Check whether any patch in the field is obvious, after a load
+  void check_settled() throw ();
+
+  /// Update frontier index after revealing patch, except for its neighbours
+  /** Returns whether the patch is a number that the player can see.  The
+   * neighbours are taken care of by reveal_nearby, in the same pass that
+   * updates their counters.
    */
-  void propagate(std::set<Coords> &work, std::set<Coords> &changes);
+  template<typename GRID> bool update_frontier(const GRID &, int row, int col);
+  /// Functor: update neighbour's place on frontier
+  class frontier_neighbour;
+  /// Functor: update neighbour's counters and frontier after revealing patch
+  class reveal_nearby;
+  void add_frontier_number(int index) throw ();
+  void remove_frontier_number(int index) throw ();
+  void add_frontier_unknown(int index) throw ();
+  void remove_frontier_unknown(int index) throw ();
+  /// Position corresponding to index into m_patches
+  Coords coords_for(int index) const throw ();
+
+  /// Parse saved game's header, setting dimensions; returns start of data
+  const char *read_state_header(const char buf[], bool &sparse);
+
+  Patch &at(int row, int col);
+  const Patch &at(int row, int col) const;
+
+  /// Draw seed for a new game from rand()
+  static unsigned long rand_seed();
 
   int index_for(int row, int col) const throw ();
-  int arraysize() const throw ();
+  int arraysize() const throw ()
+	{ return arraysize(m_rows, m_cols, m_layout); }
   void check_index(int) const;
   void check_pos(int row, int col) const;
 
   Patch *m_patches;
+  /// Frontier index: arraysize() slots holding indexes into m_patches
+  /** Frontier numbers fill the slots from the front, frontier unknowns from the
+   * back.  Each Patch on the frontier knows its slot, so it can be removed in
+   * constant time by moving the last entry into its place.
+   */
+  int *m_frontier;
+  int m_frontier_numbers, m_frontier_unknowns;
   int m_rows, m_cols;
+  Topology m_topology;
+  Layout m_layout;
   int m_intelligence;
   int m_patches_to_go;
   int m_moves;
+  /// State of this game's random number generator
+  uint64_t m_random;
+  /// Hash of mined and revealed patches, updated as they change
+  uint64_t m_digest;
+  /// Analysis for hint(), if one was ever requested for this game
+  HintCache *m_hints;
+  /// Log that moves are being recorded in, if any
+  MoveLog *m_log;
+  /// Openings labelled in advance, if index_openings() was enabled
+  OpeningIndex *m_openings;
+  /// What init_field() last set up, apart from patches it left untouched
+  /** Only a Lake that has been reset keeps this, so that creating a game
+   * never costs an allocation for it.
+   */
+  BlankField *m_blank;
+  /// Patches in the field that became obvious, waiting for propagate()
+  std::vector<Coords> m_obvious;
+  /// Does m_obvious list every obvious patch in the field?
+  /** This holds for a new game that is played at intelligence level 2 all the
+   * way.  Playing at a lower level, or carrying on after hitting a mine, can
+   * leave obvious patches that nobody looked at.
+   */
+  bool m_settled;
+
+private:
+  friend class HintCache;
+
+  BasicLake();
+  BasicLake(const BasicLake &);
+  const BasicLake &operator=(const BasicLake &);
+};
+
+
+/// The "minefield."  This is where it all happens.
+/** A Lake is a playing field of any size, chosen at runtime.  See BasicLake for
+ * the functions it shares with other kinds of minefield.
+ *
+ * Each Lake has its own random number generator for placing mines, so the same
+ * seed always produces the same game.  The constructors that do not take a seed
+ * draw one from rand(): remember to initialize the randomizer by calling
+ * srand() with some random input before starting a game that way, or you'll
+ * always get the same configuration.
+ *
+ * Thread safety: the library keeps no global state of its own, so different
+ * threads can freely work on different Lakes at the same time.  A single Lake
+ * must not be accessed by multiple threads at once without external locking,
+ * not even for reading while another thread probes it.  The functions that do
+ * not take a seed call rand(), which is not guaranteed to be thread-safe; use
+ * the seeded versions in multi-threaded programs.  See GameTable for a way to
+ * share games between threads.
+ */
+class Lake : public BasicLake
+{
+public:
+  /// Start new game
+  Lake(int rows, int cols, int mines);
+  /// Start new game, with mine placement determined by seed
+  /** Topologies other than square_topology are supported only by Lake.  A
+   * torus_topology field must be at least 3 by 3 patches.  The
+   * blocked_layout requires square_topology.
+   */
+  Lake(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	Topology=square_topology,
+	Layout=row_major_layout);
+  /// Start new game, taking the playing field's storage from pool
+  Lake(LakePool &, int rows, int cols, int mines);
+  /// Start new seeded game, taking the playing field's storage from pool
+  Lake(LakePool &,
+	int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	Topology=square_topology,
+	Layout=row_major_layout);
+  /// Start game from saved game state
+  /** The game gets row_major_layout, whatever layout it was saved from.
+   */
+  explicit Lake(const char[]);
+  /// Start game from saved game state, taking storage from pool
+  Lake(LakePool &, const char[]);
+  /// Take over other Lake's game, leaving it without a playing field
+  /** A Lake that has been moved from can only be reset, assigned to, or
+   * destroyed.
+   */
+  Lake(Lake &&) throw ();
+
+  ~Lake() throw ();
+
+  /// Take over other Lake's game, dropping our own
+  Lake &operator=(Lake &&) throw ();
+  /// Exchange games with other Lake, without copying either playing field
+  void swap(Lake &) throw ();
+
+  /// Throw away current game and start a new one in this same Lake
+  /** The existing playing field's storage is reused if it is large enough for
+   * the new game, so starting over does not normally allocate any memory.  If
+   * the new game is the same size as the last one, the border around the field
+   * is copied from that game instead of being worked out again.
+   */
+  void reset(int rows, int cols, int mines);
+  /// Start new seeded game in this same Lake; see reset(int, int, int)
+  void reset(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	Topology=square_topology,
+	Layout=row_major_layout);
+
+  /// Start new game that can be won from a given first click without guessing
+  /** Generates a board where probing the first patch, and letting the given
+   * level of intelligence propagate, reveals every clear patch.  There are no
+   * mines at or next to the first patch.  The Lake's intelligence is set to
+   * the given level.
+   *
+   * Whenever a candidate board needs guessing, the generator moves a mine away
+   * from where the solver got stuck and tries again, rather than starting
+   * over.  Several candidates are worked on in parallel by the given number of
+   * threads, or one per core if threads is zero.  The result depends only on
+   * the seed, not on the number of threads.
+   *
+   * Throws std::runtime_error if no solvable board was found, which may happen
+   * if there are too many mines.  The board always has square_topology.
+   */
+  void reset_solvable(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	Coords first,
+	int intelligence,
+	int threads=1);
+
+  /// Start new game on a huge field, generating it in tiles on many threads
+  /** The field is cut up into tiles of 256 by 256 patches.  Each tile gets its
+   * share of the mines, in proportion to its size, and draws their positions
+   * from a random stream of its own, derived from the seed.  Each tile counts
+   * the mines around its own patches; the counts for patches across the seams
+   * between tiles are fixed up at the end.  Tiles are shared out over the given
+   * number of threads, or one per core if threads is zero.
+   *
+   * The result depends only on the seed, not on the number of threads.  It is
+   * not the same game that reset() makes from the same seed, and since each
+   * tile gets a fixed number of mines, they are spread out slightly more evenly
+   * than in a game from reset().  The board always has square_topology, but
+   * may have either layout; the game is the same in both.
+   */
+  void reset_tiled(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	int threads=0,
+	Layout=row_major_layout);
+
+  /// Mark given patch as being either clear or mined
+  /** The specified amount of "intelligence" is recursively applied in revealing
+   * surrounding patches whose state becomes obvious.  Boom is thrown if the
+   * given patch is actually mined.
+   * @param row "y coordinate" of field
+   * @param col "x coordinate" of field
+   * @param changes will receive a list of all patches revealed by this move
+   * @param as_mine indicates whether user thinks this patch is mined
+   */
+  void probe(int row, int col, std::set<Coords> &changes, bool as_mine=false);
+
+private:
+  friend class SolvableSearch;
+
+  void start(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	Topology,
+	Layout);
+  /// Start new game with mines at given offsets (row*cols + col)
+  void reset_layout(int rows, int cols, const std::vector<int> &mines);
+  /// Generate tiled field; see reset_tiled
+  template<typename GRID>
+  void tile_field(const GRID &, int mines, unsigned long seed, int threads);
+  /// Scatter mines over every step-th tile, starting at first; see reset_tiled
+  template<typename GRID> void place_tiles(GRID,
+	int first,
+	int step,
+	int mines,
+	unsigned long seed,
+	std::vector<Coords> *seams,
+	uint64_t *digest);
+  /// Run place_tiles in a helper thread, catching what it throws in failure
+  template<typename GRID> void guard_tiles(GRID,
+	int first,
+	int step,
+	int mines,
+	unsigned long seed,
+	std::vector<Coords> *seams,
+	uint64_t *digest,
+	std::exception_ptr *failure);
+  /// Move mine between unexplored patches, keeping the game going
+  void move_mine(Coords from, Coords to);
+  /// Apply intelligence to patch whose neighbourhood changed, as in probe()
+  void repropagate(Coords, std::set<Coords> &changes);
+  void load_state(const char[]);
+  /// Prepare to set up a new field; a reset Lake caches its blank border
+  void reusing();
+  void allocate_patches(int);
+  void free_patches() throw ();
+
+  /// Number of Patches for which m_patches (and m_frontier) have room
+  int m_capacity;
+  /// Pool that our Patches came from, if any
+  LakePool *m_pool;
 
   Lake();
   Lake(const Lake &);
   const Lake &operator=(const Lake &);
 };
 
+
+/// Minefield whose dimensions are fixed at compile time
+/** A FixedLake plays exactly like a Lake of the same size, and saves in the
+ * same format, but keeps its playing field inline: creating one does not
+ * allocate any memory, and since the compiler knows the field's dimensions,
+ * all of the index arithmetic in the game logic boils down to constants.  This
+ * makes it much cheaper to create and play small games in bulk.
+ *
+ * The game logic is compiled into the library only for the standard sizes,
+ * available as BeginnerLake, IntermediateLake, and ExpertLake, and only in
+ * square_topology.
+ */
+template<int ROWS, int COLS> class FixedLake : public BasicLake
+{
+public:
+  /// Start new game
+  explicit FixedLake(int mines);
+  /// Start new game, with mine placement determined by seed
+  FixedLake(int mines, unsigned long seed);
+  /// Start game from saved game state, which must be of the right size
+  explicit FixedLake(const char[]);
+
+  /// Throw away current game and start a new one in this same FixedLake
+  void reset(int mines, unsigned long seed);
+
+  /// Mark given patch as being either clear or mined; see Lake::probe()
+  void probe(int row, int col, std::set<Coords> &changes, bool as_mine=false);
+
+private:
+  /// Inline storage for the playing field; constructed by the game logic
+  alignas(Patch) unsigned char
+	m_field[(ROWS+2*border)*(COLS+2*border)*sizeof(Patch)];
+  /// Inline storage for the frontier index
+  int m_frontier_index[(ROWS+2*border)*(COLS+2*border)];
+
+  FixedLake();
+  FixedLake(const FixedLake &);
+  const FixedLake &operator=(const FixedLake &);
+};
+
+extern template class FixedLake<9,9>;
+extern template class FixedLake<16,16>;
+extern template class FixedLake<16,30>;
+
+/// Classic beginner game: 9 rows of 9, typically with 10 mines
+typedef FixedLake<9,9> BeginnerLake;
+/// Classic intermediate game: 16 rows of 16, typically with 40 mines
+typedef FixedLake<16,16> IntermediateLake;
+/// Classic expert game: 16 rows of 30, typically with 99 mines
+typedef FixedLake<16,30> ExpertLake;
+
+
+/// Minefield that lives in a memory-mapped file
+/** A MappedLake keeps its playing field in a file, mapped into memory, rather
+ * than on the heap.  Opening a game just maps the file: nothing is read or
+ * parsed until the game logic touches a patch, and then only the pages it
+ * touches are loaded.  Moves change the file in place.  A playing field
+ * larger than the available memory can be played this way; the operating
+ * system pages it in and out as needed.
+ *
+ * The file consists of a 4096-byte header, followed by the playing field
+ * (arraysize() Patches, border included, row by row), followed by the
+ * frontier index (arraysize() ints).  The header holds, in this order: the
+ * magic string "minesmap"; two 32-bit unsigned integers, being the format
+ * version and sizeof(Patch); 32-bit signed integers for rows, columns,
+ * topology, intelligence, whether openings_indexed(), patches to go, moves,
+ * frontier numbers, frontier unknowns, and whether a move is in progress; and
+ * two 64-bit unsigned integers, being the state of the random number generator
+ * and the digest().  Everything is in the machine's native representation, so
+ * files can only be moved between machines (and builds of the library) that
+ * agree on that; opening a file whose Patch size does not match fails.  Files
+ * are trusted, the way a Lake trusts its memory.
+ *
+ * A move changes the playing field in place, so a crash halfway through a move
+ * leaves a game that is neither here nor there.  The header marks a move as
+ * being in progress before it changes anything, and is updated once the move
+ * is done.  Opening a file that was left in the middle of a move fails with
+ * std::runtime_error.  That only covers the program crashing, however: after
+ * a system crash, the operating system may have written some of the file's
+ * pages to disk but not others.  The file can only be relied on then if no
+ * moves were made after the last call to sync().
+ *
+ * A MappedLake does not lock its file.  Don't open the same file in more than
+ * one MappedLake at a time.
+ */
+class MappedLake : public BasicLake
+{
+public:
+  /// Create file holding a new game, replacing any file of the same name
+  MappedLake(const std::string &path,
+	int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	Topology=square_topology);
+  /// Open game in file created earlier
+  explicit MappedLake(const std::string &path);
+  /// Unmap game, after updating its header; does not flush it (see sync())
+  ~MappedLake() throw ();
+
+  /// Throw away current game, and start a new one of the same size and shape
+  void reset(int mines, unsigned long seed);
+
+  /// Mark given patch as being either clear or mined; see Lake::probe()
+  void probe(int row, int col, std::set<Coords> &changes, bool as_mine=false);
+
+  /// Write game to disk, and wait until it's there
+  void sync();
+
+private:
+  struct Header;
+
+  /// Map file of given size, and point m_patches and m_frontier into it
+  void map(std::size_t size);
+  void unmap() throw ();
+  /// Mark file header as being in the middle of a move, until store_header()
+  void begin_move() throw ();
+  /// Write game's counters and settings to file header, ending any move
+  void store_header() throw ();
+  /// Size of file for current dimensions
+  std::size_t filesize() const throw ();
+
+  std::string m_path;
+  int m_fd;
+  void *m_map;
+  std::size_t m_mapsize;
+
+  MappedLake();
+  MappedLake(const MappedLake &);
+  const MappedLake &operator=(const MappedLake &);
+};
+
+
+/// Recycling allocator for Lakes and their playing fields
+/** A server that runs through many short games will spend a lot of its time
+ * allocating and freeing Lakes of a handful of different sizes.  A LakePool
+ * keeps that memory around instead: it carves Lakes and playing fields out of
+ * larger slabs, sorted into power-of-two size classes, and recycles them when
+ * they are destroyed.  Memory is only returned to the system when the pool
+ * itself is destroyed.
+ *
+ * All Lakes created in a pool, or taking their storage from it, must be
+ * destroyed before the pool itself.  A pool is not thread-safe; give each
+ * thread its own.
+ */
+class LakePool
+{
+public:
+  LakePool();
+  ~LakePool() throw ();
+
+  /// Create new game in pool.  Clean up with destroy() later!
+  Lake *create(int rows, int cols, int mines);
+  /// Create new seeded game in pool.  Clean up with destroy() later!
+  Lake *create(int rows, int cols, int mines, unsigned long seed);
+  /// Create game from saved game state in pool.  Clean up with destroy()!
+  Lake *load(const char[]);
+  /// Destroy Lake created by create() or load(), recycling its memory
+  void destroy(Lake *) throw ();
+
+  /// Obtain a block of at least the given number of bytes
+  /** @param bytes requested size; on return, the block's actual size
+   */
+  void *allocate(std::size_t &bytes);
+  /// Return block obtained from allocate() with its actual size
+  void release(void *, std::size_t bytes) throw ();
+
+private:
+  enum { size_classes = 8*sizeof(std::size_t) };
+  static int size_class(std::size_t) throw ();
+  void add_slab(int sizeclass);
+  void push_block(int sizeclass, void *) throw ();
+
+  /// Heads of intrusive lists of free blocks, one per size class
+  void *m_free[size_classes];
+  /// Slabs allocated from the system
+  std::vector<void *> m_slabs;
+
+  LakePool(const LakePool &);
+  const LakePool &operator=(const LakePool &);
+};
+
 //@}
 
+#endif
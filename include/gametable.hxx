@@ -0,0 +1,132 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef MINES_GAMETABLE_HXX
+#define MINES_GAMETABLE_HXX
+
+/** @addtogroup CXXAPI Native C++ API to libmines
+ */
+//@{
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <stdint.h>
+
+#include "gamelogic.hxx"
+
+/// Thread-safe collection of running games, indexed by game identifier
+/** Games are spread out over a number of shards, each with its own lock.  Two
+ * threads working on different games will only contend for a lock if those
+ * games happen to live in the same shard, so with enough shards, threads can
+ * probe different games at the same time without getting in each other's way.
+ *
+ * The table owns the Lakes that are inserted into it.  They must have been
+ * created with new (or mines_init()/mines_load() in the C API), and are
+ * deleted when the table is destroyed, unless they were removed before.
+ */
+class GameTable
+{
+public:
+  /// Create empty table with at least the given number of shards
+  explicit GameTable(int shards=64);
+  ~GameTable() throw ();
+
+  /// Add game to table, taking ownership.  Returns false if id already in use.
+  bool insert(uint64_t id, Lake *);
+
+  /// Take game out of table, returning ownership to caller (or null if absent)
+  Lake *remove(uint64_t id);
+
+  /// Apply functor f to game with given id, while holding its shard's lock
+  /** Returns false if there is no game with that id.  The functor is called
+   * with a Lake & argument, and must not hang on to it after returning.
+   * Exceptions thrown by f, including Boom, are passed on to the caller.
+   */
+  template<typename FUNCT> bool apply(uint64_t id, FUNCT f)
+  {
+    Shard &s = shard_for(id);
+    std::lock_guard<std::mutex> lock(s.lock);
+    const std::map<uint64_t,Lake *>::iterator i = s.games.find(id);
+    if (i == s.games.end()) return false;
+    f(*i->second);
+    return true;
+  }
+
+  /// Delete every game for which pred returns true
+  /** The predicate is called with a game's id and a Lake & argument, while
+   * holding the lock of the game's shard, so no other thread can touch the game
+   * in between.  It must not hang on to the Lake after returning.  Returns the
+   * number of games deleted.
+   */
+  template<typename PRED> int remove_if(PRED pred)
+  {
+    int removed = 0;
+    typedef std::vector<Shard>::iterator shard_iter;
+    typedef std::map<uint64_t,Lake *>::iterator game_iter;
+    for (shard_iter s = m_shards.begin(); s != m_shards.end(); ++s)
+    {
+      std::lock_guard<std::mutex> lock(s->lock);
+      for (game_iter i = s->games.begin(); i != s->games.end(); )
+      {
+	if (!pred(i->first, *i->second))
+	{
+	  ++i;
+	  continue;
+	}
+	delete i->second;
+	s->games.erase(i++);
+	++removed;
+      }
+    }
+    return removed;
+  }
+
+  /// Probe game with given id, as with Lake::probe()
+  /** Returns false if there is no game with that id.
+   */
+  bool probe(uint64_t id,
+	int row,
+	int col,
+	std::set<Coords> &changes,
+	bool as_mine=false);
+
+  /// Number of games in table (may already be out of date when it returns)
+  int size();
+
+private:
+  /// One lock and the games it protects, padded to avoid false sharing
+  struct alignas(64) Shard
+  {
+    std::mutex lock;
+    std::map<uint64_t,Lake *> games;
+  };
+
+  Shard &shard_for(uint64_t id) throw ();
+
+  std::vector<Shard> m_shards;
+
+  GameTable(const GameTable &);
+  const GameTable &operator=(const GameTable &);
+};
+
+//@}
+
+#endif
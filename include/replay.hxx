@@ -0,0 +1,109 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef MINES_REPLAY_HXX
+#define MINES_REPLAY_HXX
+
+/** @addtogroup CXXAPI Native C++ API to libmines
+ */
+//@{
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "gamelogic.hxx"
+
+/// Record of the moves made in a game, for exact replay
+/** To record a game, pass a MoveLog to BasicLake::record().  The log takes a
+ * snapshot of the game as it is at that point, and from then on notes down
+ * every move: where it was made, whether the player said it was a mine, the
+ * intelligence level at the time, and how it turned out.  Every so many moves
+ * it also takes a fingerprint of the game's complete state (see
+ * BasicLake::digest()) as a checkpoint.
+ *
+ * Since a game's outcome depends only on its starting state and the moves
+ * made, replay() can reconstruct it exactly, at full speed.  That makes a
+ * saved log good for reproducing a player's session, and for profiling with a
+ * realistic workload that is the same every time.
+ */
+class MoveLog
+{
+public:
+  /// One recorded move
+  struct Move
+  {
+    /// Coordinates of patch probed
+    int row, col;
+    /// Patches still to go after the move, or -1 if it blew up
+    int to_go;
+    /// Intelligence level the move was made with
+    unsigned char intelligence;
+    /// Did the player say the patch was mined?
+    bool as_mine;
+  };
+
+  /// Create empty log, with a checkpoint every interval moves (0 for none)
+  explicit MoveLog(int checkpoint_interval=0);
+  /// Load log written by save()
+  explicit MoveLog(const char[]);
+
+  /// Discard any previous contents, and start from game's current state
+  /** This is called by BasicLake::record(); there should be no need to call it
+   * directly.
+   */
+  void start(const BasicLake &);
+  /// Note down move just made in given game; called by the game itself
+  void record(const BasicLake &, Coords, bool as_mine, int to_go);
+
+  /// Number of moves recorded
+  int moves() const throw () { return int(m_moves.size()); }
+  /// Recorded move number i, counting from zero
+  const Move &move(int i) const { return m_moves.at(i); }
+
+  /// Maximum number of bytes required to save this log
+  int savesize() const throw ();
+  /// Write log (in ASCII) to memory buffer at least savesize() bytes large
+  /** Returns number of bytes written, not including the terminating zero.
+   */
+  int save(char buf[]) const;
+
+  /// Re-enact recorded game, returning the resulting Lake
+  /** Creates a Lake from the recorded starting state, and makes the recorded
+   * moves in it.  If verify is true, checks each move's outcome and each
+   * checkpoint along the way, and throws std::runtime_error at the first
+   * difference.  The caller owns the returned Lake, and must delete it.
+   */
+  Lake *replay(bool verify=true) const;
+
+private:
+  /// Saved state of the game when recording started
+  std::string m_start;
+  std::vector<Move> m_moves;
+  int m_interval;
+  /// Game fingerprint after every m_interval moves
+  std::vector<uint64_t> m_checkpoints;
+
+  MoveLog(const MoveLog &);
+  const MoveLog &operator=(const MoveLog &);
+};
+
+//@}
+
+#endif
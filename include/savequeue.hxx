@@ -0,0 +1,115 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef MINES_SAVEQUEUE_HXX
+#define MINES_SAVEQUEUE_HXX
+
+/** @addtogroup CXXAPI Native C++ API to libmines
+ */
+//@{
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include "archive.hxx"
+
+/// Write-behind storage of games in a GameArchive
+/** Storing a game in a durable archive means waiting for the disk.  A server
+ * that does that on the path of every move spends most of its time waiting.  A
+ * SaveQueue takes the game's saved state instead, and leaves the writing to a
+ * background thread.
+ *
+ * Games that are stored again before the writer gets to them are only written
+ * once, in their latest state.  The writer takes everything that was queued
+ * while it was busy, and stores it in one go, so those games share a single
+ * flush to disk.  The busier the queue, the larger these batches become.
+ *
+ * Call flush() to wait until everything queued so far is safely stored, e.g.
+ * before shutting down, or before telling a client that its game is saved.
+ * The destructor does the same, but has no way of reporting errors.
+ *
+ * A SaveQueue is thread-safe.  It opens the archive for its own use; other
+ * GameArchive objects, in this or other processes, can use the same file.
+ */
+class SaveQueue
+{
+public:
+  /// Open archive, as with GameArchive, and start writer thread
+  explicit SaveQueue(const std::string &path, bool durable=true);
+  /// Write any games still queued, then stop
+  ~SaveQueue() throw ();
+
+  /// Queue game to be stored under given id
+  /** The game's state is saved right away, so the caller may go on playing as
+   * soon as this returns.
+   */
+  void store(uint64_t id, const BasicLake &);
+  /// Queue saved game state, as written by BasicLake::save()
+  void store(uint64_t id, const char state[], std::size_t length);
+
+  /// Wait until every game queued so far has been stored
+  /** If the writer failed to store games, throws std::runtime_error.  Those
+   * games stay queued, and the writer tries again on the next store() or
+   * flush().
+   */
+  void flush();
+
+  /// Number of games waiting to be written
+  std::size_t pending();
+
+private:
+  typedef std::map<uint64_t, std::vector<char> > Batch;
+
+  /// Queue state for writing, taking over its contents
+  void enqueue(uint64_t id, std::vector<char> &state);
+  /// Writer thread's main loop
+  void run() throw ();
+
+  /// Used only by the writer thread, once it's started
+  GameArchive m_archive;
+
+  std::mutex m_lock;
+  /// Signals writer that there's work, or that it's time to stop
+  std::condition_variable m_work;
+  /// Signals waiting flush() calls that a batch has been written
+  std::condition_variable m_written;
+  /// Games waiting to be written, with their latest states
+  Batch m_queue;
+  /// Number of store() calls so far, and number covered by writes so far
+  uint64_t m_queued, m_stored;
+  /// Last write error, if the queued games could not be stored
+  std::string m_error;
+  /// Should the writer retry after an error?
+  bool m_retry;
+  bool m_stop;
+
+  std::thread m_writer;
+
+  SaveQueue(const SaveQueue &);
+  const SaveQueue &operator=(const SaveQueue &);
+};
+
+//@}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#ifndef MINES_SHAREDLAKE_HXX
+#define MINES_SHAREDLAKE_HXX
+
+/** @addtogroup CXXAPI Native C++ API to libmines
+ */
+//@{
+
+#include <atomic>
+#include <set>
+#include <vector>
+
+#include "gamelogic.hxx"
+
+/// One playing field, cleared by many players at the same time
+/** A Lake can only be probed by one thread at a time: a single move can ripple
+ * out over any part of the field, and updates counters and indexes all over
+ * the place.  A SharedLake is a board for co-operative play instead, where
+ * any number of threads probe the same field at the same time.
+ *
+ * Each patch keeps its state in a single atomic byte.  Where it is and isn't
+ * mined never changes once the board is set up; the only thing that changes
+ * during play is whether a patch has been revealed.  A thread that reveals a
+ * patch sets that bit atomically, and only the thread that actually flipped it
+ * goes on to reveal the neighbours of a patch without mines around it.  So
+ * probes in different parts of the field never wait for each other, cascades
+ * that run into each other simply split up the work, and since there are no
+ * locks, nothing can deadlock.
+ *
+ * The board plays by the classic rules, like a LakeBatch at intelligence level
+ * 1, in square_topology.  It gets the same mines as a Lake of the same size
+ * created with the same seed.  Hitting a mine throws Boom at the player who
+ * did it, but the game goes on for everyone: the mine stays visible, and the
+ * board is cleared once every clear patch has been revealed.  Since revealing
+ * patches is all that ever happens, the order in which the probes arrive
+ * makes no difference to the final state of the board.
+ *
+ * All member functions except the constructor and destructor are thread-safe.
+ */
+class SharedLake
+{
+public:
+  /// Set up new game, with mine placement determined by seed
+  SharedLake(int rows, int cols, int mines, unsigned long seed);
+
+  /// Number of rows making up this board
+  int rows() const throw () { return m_rows; }
+  /// Number of columns making up this board
+  int cols() const throw () { return m_cols; }
+
+  /// Number of unmined patches still to be revealed
+  int to_go() const throw () { return m_to_go.load(); }
+  /// Number of probes that revealed something, by all players together
+  int moves() const throw () { return m_moves.load(); }
+  /// Number of mines that have gone off
+  int booms() const throw () { return m_booms.load(); }
+
+  /// Status of patch, as in BasicLake::status_at()
+  /** Only patches inside the playing field can be queried.
+   */
+  char status_at(int row, int col) const;
+
+  /// Probe patch, revealing it and, if it has no mines around it, its opening
+  /** Probing a patch that has already been revealed, possibly by another
+   * player at the same time, does nothing.  Throws Boom if the patch is
+   * mined.
+   * @param changes will receive the patches that this call revealed
+   */
+  void probe(int row, int col, std::set<Coords> &changes);
+
+private:
+  /// Each patch's byte holds its number of nearby mines, and these bits
+  enum { near_mask = 0x0f, mined_bit = 0x10, revealed_bit = 0x20 };
+
+  int index_for(int row, int col) const throw ()
+	{ return (row+1)*(m_cols+2) + col + 1; }
+  Coords coords_for(int index) const throw ()
+	{ return Coords(index/(m_cols+2) - 1, index%(m_cols+2) - 1); }
+  void check_pos(int row, int col) const;
+  /// Functor: place mine and count it in its neighbours, for the constructor
+  class place_mine;
+
+  int m_rows, m_cols;
+  /// Per patch, including a one-patch border that counts as revealed
+  std::vector<std::atomic<unsigned char> > m_cells;
+  std::atomic<int> m_to_go, m_moves, m_booms;
+
+  SharedLake(const SharedLake &);
+  const SharedLake &operator=(const SharedLake &);
+};
+
+//@}
+
+#endif
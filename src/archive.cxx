@@ -0,0 +1,743 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+// Archive file holding many saved games.
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive.hxx"
+#include "random.hxx"
+
+using namespace std;
+
+namespace
+{
+const char archive_magic[8] = { 'm', 'i', 'n', 'e', 's', 'a', 'r', 'c' };
+const uint32_t format_version = 1;
+
+/// Room for each of the two copies of the superblock at the start of the file
+const uint64_t super_room = 2048;
+
+/// Smallest slot size is 2^min_slot_bits bytes
+const int min_slot_bits = 8;
+
+/// Number of buckets in a new archive's index
+const uint64_t initial_buckets = 1024;
+
+/// Index entry: game id and file offset of its slot
+struct Bucket
+{
+  uint64_t id;
+  /// Slot's file offset, or empty_bucket or deleted_bucket
+  uint64_t slot;
+};
+
+/// Special values for Bucket::slot
+const uint64_t empty_bucket = 0, deleted_bucket = 1;
+
+/// Start of a slot; followed by the slot's two copies of its game
+struct SlotHeader
+{
+  uint64_t id;
+  uint32_t sizeclass;
+  uint32_t padding;
+  /// Next slot in free list, if this slot is free
+  uint64_t next_free;
+  uint64_t reserved;
+};
+
+/// Start of a copy of a game, followed by the saved game itself
+struct CopyHeader
+{
+  /// Zero if this copy was never written
+  uint64_t sequence;
+  uint64_t length;
+  /// Checksum over game id, sequence, length, and data
+  uint64_t checksum;
+};
+
+
+uint64_t fnv1a(const void *data,
+	size_t len,
+	uint64_t h=UINT64_C(0xcbf29ce484222325)) throw ()
+{
+  const unsigned char *const p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < len; ++i) h = (h ^ p[i]) * UINT64_C(0x100000001b3);
+  return h;
+}
+
+
+uint64_t copy_checksum(uint64_t id, const CopyHeader &h, const char data[])
+	throw ()
+{
+  const uint64_t sum = fnv1a(&id, sizeof(id));
+  return fnv1a(data, h.length, fnv1a(&h, offsetof(CopyHeader, checksum), sum));
+}
+
+
+uint64_t slot_size(int sizeclass) throw ()
+{
+  return uint64_t(1) << (sizeclass + min_slot_bits);
+}
+
+
+/// Room for one copy of a game in a slot, including its CopyHeader
+uint64_t copy_room(int sizeclass) throw ()
+{
+  return (slot_size(sizeclass) - sizeof(SlotHeader)) / 2;
+}
+
+
+uint64_t copy_offset(uint64_t slot, int sizeclass, int copy) throw ()
+{
+  return slot + sizeof(SlotHeader) + copy*copy_room(sizeclass);
+}
+
+
+/// Smallest size class whose slots can hold a game of given length
+int class_for(size_t length) throw ()
+{
+  int c = 0;
+  while (copy_room(c) < length + sizeof(CopyHeader)) ++c;
+  return c;
+}
+
+
+/// Index size for a given number of games, leaving plenty of room to grow
+uint64_t buckets_for(uint64_t games) throw ()
+{
+  uint64_t buckets = initial_buckets;
+  while (buckets*3 < games*8) buckets *= 2;
+  return buckets;
+}
+
+
+uint64_t hash_id(uint64_t id) throw ()
+{
+  return splitmix64(id);
+}
+
+
+void fail(const string &what)
+{
+  throw runtime_error(what + ": " + strerror(errno));
+}
+
+
+void read_at(int fd, void *buf, size_t len, uint64_t offset)
+{
+  char *here = static_cast<char *>(buf);
+  while (len)
+  {
+    const ssize_t bytes = pread(fd, here, len, off_t(offset));
+    if (bytes < 0 && errno == EINTR) continue;
+    if (bytes < 0) fail("Could not read game archive");
+    if (!bytes) throw runtime_error("Game archive is truncated");
+    here += bytes;
+    len -= bytes;
+    offset += bytes;
+  }
+}
+
+
+void write_at(int fd, const void *buf, size_t len, uint64_t offset)
+{
+  const char *here = static_cast<const char *>(buf);
+  while (len)
+  {
+    const ssize_t bytes = pwrite(fd, here, len, off_t(offset));
+    if (bytes < 0 && errno == EINTR) continue;
+    if (bytes <= 0) fail("Could not write game archive");
+    here += bytes;
+    len -= bytes;
+    offset += bytes;
+  }
+}
+
+
+int open_archive(const string &path)
+{
+  const int fd = open(path.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+  if (fd == -1) fail("Could not open game archive " + path);
+  return fd;
+}
+
+
+/// Flush directory containing path, so a rename in it survives a crash
+void sync_directory(const string &path)
+{
+  const string::size_type slash = path.rfind('/');
+  const string dir = (slash == string::npos) ? "." : path.substr(0, slash+1);
+  const int fd = open(dir.c_str(), O_RDONLY|O_CLOEXEC);
+  if (fd == -1) fail("Could not open directory " + dir);
+  const int result = fsync(fd);
+  close(fd);
+  if (result) fail("Could not flush directory " + dir);
+}
+} // namespace
+
+
+/// Holds lock on archive file for the duration of an operation
+class GameArchive::Lock
+{
+public:
+  Lock(GameArchive &archive, bool exclusive) : m_archive(archive)
+	{ m_archive.lock(exclusive); }
+  ~Lock() throw () { m_archive.unlock(); }
+private:
+  GameArchive &m_archive;
+};
+
+
+GameArchive::GameArchive(const string &path, bool durable) :
+  m_path(path),
+  m_fd(-1),
+  m_durable(durable),
+  m_super()
+{
+  open_file();
+  try
+  {
+    // Make sure the file is set up, and is really an archive
+    Lock check(*this, false);
+  }
+  catch (...)
+  {
+    close(m_fd);
+    throw;
+  }
+}
+
+
+GameArchive::~GameArchive() throw ()
+{
+  close(m_fd);
+}
+
+
+Lake *GameArchive::load(uint64_t id)
+{
+  vector<char> state;
+  return load(id, state) ? new Lake(&state[0]) : 0;
+}
+
+
+bool GameArchive::load(uint64_t id, vector<char> &state)
+{
+  Lock lock(*this, false);
+  bool found;
+  const uint64_t b = find(id, found);
+  if (!found) return false;
+
+  Bucket entry;
+  read_at(m_fd, &entry, sizeof(entry), bucket_offset(b));
+  uint64_t sequence;
+  int sizeclass;
+  read_slot(entry.slot, id, state, sequence, sizeclass);
+  return true;
+}
+
+
+void GameArchive::store(uint64_t id, const BasicLake &lake)
+{
+  vector<char> state(lake.savesize());
+  const int length = lake.save(&state[0]);
+  store(id, &state[0], length);
+}
+
+
+void GameArchive::store(uint64_t id, const char state[], size_t length)
+{
+  if (class_for(length) >= size_classes)
+    throw length_error("Game too large for archive");
+
+  Lock lock(*this, true);
+  if (put(id, state, length)) sync();
+}
+
+
+void GameArchive::store(const map<uint64_t, vector<char> > &games)
+{
+  typedef map<uint64_t, vector<char> >::const_iterator iter;
+  for (iter i = games.begin(); i != games.end(); ++i)
+    if (i->second.empty() || class_for(i->second.size()) >= size_classes)
+      throw length_error("Game too large for archive");
+
+  Lock lock(*this, true);
+  bool unsynced = false;
+  for (iter i = games.begin(); i != games.end(); ++i)
+    if (put(i->first, &i->second[0], i->second.size())) unsynced = true;
+  if (unsynced) sync();
+}
+
+
+bool GameArchive::put(uint64_t id, const char state[], size_t length)
+{
+  bool found;
+  uint64_t b = find(id, found);
+  Bucket entry;
+  if (found)
+  {
+    read_at(m_fd, &entry, sizeof(entry), bucket_offset(b));
+    vector<char> old;
+    uint64_t sequence;
+    int sizeclass;
+    const int copy = read_slot(entry.slot, id, old, sequence, sizeclass);
+    if (class_for(length) <= sizeclass)
+    {
+      // Overwrite the older copy; the newer one stays intact until we're done
+      write_copy(m_fd, entry.slot, id, sizeclass, 1-copy, sequence+1,
+	  state, length);
+      return true;
+    }
+
+    // Game outgrew its slot.  Move it, and only then recycle the old slot.
+    const uint64_t slot = place(id, state, length);
+    write_at(m_fd, &slot, sizeof(slot),
+	bucket_offset(b) + offsetof(Bucket, slot));
+    sync();
+    release(entry.slot, sizeclass);
+    write_super();
+    sync();
+    return false;
+  }
+
+  if ((m_super.used+1)*4 > m_super.buckets*3)
+  {
+    grow_index();
+    b = find(id, found);
+  }
+  read_at(m_fd, &entry, sizeof(entry), bucket_offset(b));
+
+  // Counts go up before the game goes in, so a crash can't leave them too low
+  if (entry.slot == empty_bucket) ++m_super.used;
+  ++m_super.games;
+  entry.id = id;
+  entry.slot = place(id, state, length);
+  write_at(m_fd, &entry, sizeof(entry), bucket_offset(b));
+  sync();
+  return false;
+}
+
+
+bool GameArchive::remove(uint64_t id)
+{
+  Lock lock(*this, true);
+  bool found;
+  const uint64_t b = find(id, found);
+  if (!found) return false;
+
+  Bucket entry;
+  read_at(m_fd, &entry, sizeof(entry), bucket_offset(b));
+  SlotHeader header;
+  read_at(m_fd, &header, sizeof(header), entry.slot);
+
+  const uint64_t deleted = deleted_bucket;
+  write_at(m_fd, &deleted, sizeof(deleted),
+	bucket_offset(b) + offsetof(Bucket, slot));
+  sync();
+  --m_super.games;
+  release(entry.slot, header.sizeclass);
+  write_super();
+  sync();
+  return true;
+}
+
+
+uint64_t GameArchive::size()
+{
+  Lock lock(*this, false);
+  return m_super.games;
+}
+
+
+void GameArchive::compact()
+{
+  Lock lock(*this, true);
+
+  const string temp = m_path + ".compact";
+  const int fd = open(temp.c_str(), O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+  if (fd == -1) fail("Could not create " + temp);
+
+  Superblock super;
+  try
+  {
+    // Anyone who opens the new file must wait until we're done with it
+    if (flock(fd, LOCK_EX) != 0) fail("Could not lock " + temp);
+
+    vector<Bucket> old(m_super.buckets);
+    read_at(m_fd, &old[0], old.size()*sizeof(Bucket), m_super.index);
+
+    init_super(super, buckets_for(m_super.games));
+    vector<Bucket> index(super.buckets);
+    const uint64_t mask = super.buckets - 1;
+    vector<char> data;
+    for (vector<Bucket>::const_iterator i = old.begin(); i != old.end(); ++i)
+    {
+      if (i->slot == empty_bucket || i->slot == deleted_bucket) continue;
+      uint64_t sequence;
+      int sizeclass;
+      read_slot(i->slot, i->id, data, sequence, sizeclass);
+      const size_t length = data.size() - 1;
+      sizeclass = class_for(length);
+      const uint64_t slot = super.end;
+      super.end += slot_size(sizeclass);
+      init_slot(fd, slot, i->id, sizeclass, &data[0], length);
+
+      uint64_t b = hash_id(i->id) & mask;
+      while (index[b].slot != empty_bucket) b = (b+1) & mask;
+      index[b].id = i->id;
+      index[b].slot = slot;
+      ++super.used;
+      ++super.games;
+    }
+    write_at(fd, &index[0], index.size()*sizeof(Bucket), super.index);
+    write_super(fd, super);
+    write_super(fd, super);
+
+    if (m_durable && fsync(fd) != 0) fail("Could not flush " + temp);
+    if (rename(temp.c_str(), m_path.c_str()) != 0)
+      fail("Could not replace game archive " + m_path);
+  }
+  catch (...)
+  {
+    unlink(temp.c_str());
+    close(fd);
+    throw;
+  }
+
+  // Closing the old file releases its lock.  Anyone waiting for it will find
+  // that the file has been replaced, and will wait for the new one.
+  close(m_fd);
+  m_fd = fd;
+  m_super = super;
+  if (m_durable) sync_directory(m_path);
+}
+
+
+void GameArchive::open_file()
+{
+  m_fd = open_archive(m_path);
+}
+
+
+void GameArchive::lock(bool exclusive)
+{
+  for (;;)
+  {
+    if (flock(m_fd, exclusive ? LOCK_EX : LOCK_SH) != 0)
+    {
+      if (errno == EINTR) continue;
+      fail("Could not lock game archive " + m_path);
+    }
+
+    try
+    {
+      struct stat ours, current;
+      if (fstat(m_fd, &ours) != 0) fail("Could not stat " + m_path);
+      if (stat(m_path.c_str(), &current) == 0 &&
+	  (current.st_ino != ours.st_ino || current.st_dev != ours.st_dev))
+      {
+	// compact() replaced the file.  Switch to the new one.
+	const int fd = open_archive(m_path);
+	close(m_fd);
+	m_fd = fd;
+	continue;
+      }
+
+      if (!ours.st_size)
+      {
+	// New file.  Set it up, but only while nobody else can see it.
+	if (!exclusive)
+	{
+	  unlock();
+	  exclusive = true;
+	  continue;
+	}
+	initialize();
+      }
+
+      read_super();
+      return;
+    }
+    catch (...)
+    {
+      unlock();
+      throw;
+    }
+  }
+}
+
+
+void GameArchive::unlock() throw ()
+{
+  flock(m_fd, LOCK_UN);
+}
+
+
+void GameArchive::initialize()
+{
+  init_super(m_super, initial_buckets);
+  const vector<Bucket> index(m_super.buckets, Bucket());
+  write_at(m_fd, &index[0], index.size()*sizeof(Bucket), m_super.index);
+  sync();
+  write_super();
+  write_super();
+  sync();
+}
+
+
+void GameArchive::read_super()
+{
+  Superblock copies[2];
+  const Superblock *best = 0;
+  for (int i = 0; i < 2; ++i)
+  {
+    const Superblock &s = copies[i];
+    read_at(m_fd, &copies[i], sizeof(copies[i]), i*super_room);
+    if (memcmp(s.magic, archive_magic, sizeof(s.magic)) == 0 &&
+        s.version == format_version &&
+        s.checksum == fnv1a(&s, offsetof(Superblock, checksum)) &&
+	(!best || s.sequence > best->sequence))
+      best = &s;
+  }
+  if (!best) throw runtime_error("Not a valid game archive: " + m_path);
+  m_super = *best;
+}
+
+
+void GameArchive::write_super()
+{
+  write_super(m_fd, m_super);
+}
+
+
+void GameArchive::sync()
+{
+  if (m_durable && fdatasync(m_fd) != 0)
+    fail("Could not flush game archive " + m_path);
+}
+
+
+uint64_t GameArchive::find(uint64_t id, bool &found)
+{
+  const uint64_t mask = m_super.buckets - 1;
+  uint64_t b = hash_id(id) & mask, insert_at = m_super.buckets;
+  found = false;
+  for (uint64_t n = 0; n < m_super.buckets; ++n, b = (b+1) & mask)
+  {
+    Bucket entry;
+    read_at(m_fd, &entry, sizeof(entry), bucket_offset(b));
+    if (entry.slot == empty_bucket)
+      return (insert_at < m_super.buckets) ? insert_at : b;
+    if (entry.slot == deleted_bucket)
+    {
+      if (insert_at == m_super.buckets) insert_at = b;
+    }
+    else if (entry.id == id)
+    {
+      found = true;
+      return b;
+    }
+  }
+  return insert_at;
+}
+
+
+uint64_t GameArchive::bucket_offset(uint64_t bucket) const throw ()
+{
+  return m_super.index + bucket*sizeof(Bucket);
+}
+
+
+int GameArchive::read_slot(uint64_t slot,
+	uint64_t id,
+	vector<char> &data,
+	uint64_t &sequence,
+	int &sizeclass)
+{
+  SlotHeader header;
+  read_at(m_fd, &header, sizeof(header), slot);
+  if (header.id != id || header.sizeclass >= unsigned(size_classes))
+    throw runtime_error("Game archive is corrupt: bad index entry");
+  sizeclass = int(header.sizeclass);
+
+  CopyHeader copies[2];
+  for (int c = 0; c < 2; ++c)
+    read_at(m_fd, &copies[c], sizeof(copies[c]), copy_offset(slot,sizeclass,c));
+
+  // Try the newer copy first.  If it was only partly written, use the other.
+  const int newest = (copies[1].sequence > copies[0].sequence);
+  for (int i = 0; i < 2; ++i)
+  {
+    const int c = i ? 1-newest : newest;
+    const CopyHeader &h = copies[c];
+    if (!h.sequence || h.length > copy_room(sizeclass)-sizeof(CopyHeader))
+      continue;
+    data.resize(h.length + 1);
+    read_at(m_fd, &data[0], h.length,
+	copy_offset(slot,sizeclass,c) + sizeof(CopyHeader));
+    if (copy_checksum(id, h, &data[0]) == h.checksum)
+    {
+      data[h.length] = '\0';
+      sequence = h.sequence;
+      return c;
+    }
+  }
+  throw runtime_error("Game archive is corrupt: no intact copy of game");
+}
+
+
+uint64_t GameArchive::place(uint64_t id, const char data[], size_t length)
+{
+  const int sizeclass = class_for(length);
+  const uint64_t slot = allocate(sizeclass);
+  // Record the allocation before the slot gets used
+  write_super();
+  sync();
+  init_slot(m_fd, slot, id, sizeclass, data, length);
+  sync();
+  return slot;
+}
+
+
+uint64_t GameArchive::allocate(int sizeclass)
+{
+  uint64_t slot = m_super.free[sizeclass];
+  if (slot)
+  {
+    SlotHeader header;
+    read_at(m_fd, &header, sizeof(header), slot);
+    m_super.free[sizeclass] = header.next_free;
+  }
+  else
+  {
+    slot = m_super.end;
+    m_super.end += slot_size(sizeclass);
+  }
+  return slot;
+}
+
+
+void GameArchive::release(uint64_t slot, int sizeclass)
+{
+  SlotHeader header = SlotHeader();
+  header.sizeclass = sizeclass;
+  header.next_free = m_super.free[sizeclass];
+  write_at(m_fd, &header, sizeof(header), slot);
+  sync();
+  m_super.free[sizeclass] = slot;
+}
+
+
+void GameArchive::grow_index()
+{
+  vector<Bucket> old(m_super.buckets);
+  read_at(m_fd, &old[0], old.size()*sizeof(Bucket), m_super.index);
+
+  const uint64_t buckets = buckets_for(m_super.games + 1),
+	mask = buckets - 1;
+  vector<Bucket> index(buckets, Bucket());
+  uint64_t used = 0;
+  for (vector<Bucket>::const_iterator i = old.begin(); i != old.end(); ++i)
+  {
+    if (i->slot == empty_bucket || i->slot == deleted_bucket) continue;
+    uint64_t b = hash_id(i->id) & mask;
+    while (index[b].slot != empty_bucket) b = (b+1) & mask;
+    index[b] = *i;
+    ++used;
+  }
+
+  // Write the new index into unused space, then switch over to it.  The old
+  // index's space is not reused until the archive is compacted.
+  write_at(m_fd, &index[0], index.size()*sizeof(Bucket), m_super.end);
+  sync();
+  m_super.index = m_super.end;
+  m_super.buckets = buckets;
+  m_super.used = used;
+  m_super.end += buckets*sizeof(Bucket);
+  write_super();
+  sync();
+}
+
+
+void GameArchive::init_super(Superblock &s, uint64_t buckets)
+{
+  memset(&s, 0, sizeof(s));
+  memcpy(s.magic, archive_magic, sizeof(s.magic));
+  s.version = format_version;
+  s.index = 2*super_room;
+  s.buckets = buckets;
+  s.end = s.index + buckets*sizeof(Bucket);
+}
+
+
+void GameArchive::write_super(int fd, Superblock &s)
+{
+  ++s.sequence;
+  s.checksum = fnv1a(&s, offsetof(Superblock, checksum));
+  write_at(fd, &s, sizeof(s), (s.sequence % 2) * super_room);
+}
+
+
+void GameArchive::init_slot(int fd,
+	uint64_t slot,
+	uint64_t id,
+	int sizeclass,
+	const char data[],
+	size_t length)
+{
+  SlotHeader header = SlotHeader();
+  header.id = id;
+  header.sizeclass = sizeclass;
+  write_at(fd, &header, sizeof(header), slot);
+
+  // A recycled slot may still hold copies of an older game
+  const CopyHeader blank = CopyHeader();
+  write_at(fd, &blank, sizeof(blank), copy_offset(slot,sizeclass,1));
+  write_copy(fd, slot, id, sizeclass, 0, 1, data, length);
+}
+
+
+void GameArchive::write_copy(int fd,
+	uint64_t slot,
+	uint64_t id,
+	int sizeclass,
+	int copy,
+	uint64_t sequence,
+	const char data[],
+	size_t length)
+{
+  CopyHeader header;
+  header.sequence = sequence;
+  header.length = length;
+  header.checksum = copy_checksum(id, header, data);
+  const uint64_t offset = copy_offset(slot, sizeclass, copy);
+  write_at(fd, data, length, offset + sizeof(header));
+  write_at(fd, &header, sizeof(header), offset);
+}
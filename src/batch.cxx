@@ -0,0 +1,310 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Batches of same-sized games, played in lockstep, 64 boards to a word.
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "batch.hxx"
+#include "random.hxx"
+
+using namespace std;
+
+namespace
+{
+/// Number of bits set in word
+int count_bits(uint64_t x) throw ()
+{
+  int n = 0;
+  for (; x; x &= x-1) ++n;
+  return n;
+}
+} // namespace
+
+
+LakeBatch::LakeBatch(int boards, int rows, int cols) :
+  m_boards(boards),
+  m_rows(rows),
+  m_cols(cols),
+  m_words((boards+lanebits-1)/lanebits),
+  m_intelligence(1),
+  m_mined(),
+  m_revealed(),
+  m_empty(),
+  m_flooded(),
+  m_playing(m_words),
+  m_lost(m_words),
+  m_moves(boards),
+  m_active()
+{
+  if (boards <= 0 || rows <= 0 || cols <= 0)
+    throw invalid_argument("Invalid batch dimensions");
+  const int planesize = (rows+2)*(cols+2)*m_words;
+  m_mined.resize(planesize);
+  m_revealed.resize(planesize);
+  m_empty.resize(planesize);
+  m_flooded.resize(planesize);
+  m_active.reserve(m_words);
+}
+
+
+class LakeBatch::place_mine
+{
+public:
+  place_mine(LakeBatch &batch, int board) : m_batch(batch), m_board(board) {}
+  bool operator()(int row, int col) const
+  {
+    Lanes &m = m_batch.plane(m_batch.m_mined, m_batch.index_for(row,col))
+	[m_board / lanebits];
+    if (m & bit(m_board)) return false;
+    m |= bit(m_board);
+    return true;
+  }
+
+private:
+  LakeBatch &m_batch;
+  int m_board;
+};
+
+
+void LakeBatch::reset(int mines, unsigned long seed)
+{
+  if (mines < 0 || mines > m_rows*m_cols)
+    throw invalid_argument("Number of mines does not fit on board");
+
+  fill(m_mined.begin(), m_mined.end(), 0);
+  fill(m_empty.begin(), m_empty.end(), 0);
+  fill(m_flooded.begin(), m_flooded.end(), 0);
+  fill(m_moves.begin(), m_moves.end(), 0);
+  fill(m_lost.begin(), m_lost.end(), 0);
+
+  // The border counts as revealed, but is never mined or empty
+  fill(m_revealed.begin(), m_revealed.end(), ~Lanes(0));
+  for (int r = 0; r < m_rows; ++r)
+    fill_n(plane(m_revealed, index_for(r,0)), m_cols*m_words, 0);
+
+  for (int b = 0; b < m_boards; ++b)
+    scatter_mines(seed + b, m_rows, m_cols, mines, place_mine(*this, b));
+
+  const int stride = m_cols + 2;
+  for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+  {
+    const int k = index_for(r,c);
+    Lanes *const e = plane(m_empty, k);
+    for (int w = 0; w < m_words; ++w)
+    {
+      Lanes near = 0;
+      for (int dr = -stride; dr <= stride; dr += stride)
+	for (int dc = -1; dc <= 1; ++dc)
+	  near |= plane(m_mined, k+dr+dc)[w];
+      e[w] = ~near;
+    }
+  }
+
+  for (int w = 0; w < m_words; ++w) m_playing[w] = ~Lanes(0);
+  if (m_boards % lanebits)
+    m_playing[m_words-1] = bit(m_boards) - 1;
+  settle();
+}
+
+
+int LakeBatch::playing() const throw ()
+{
+  int n = 0;
+  for (int w = 0; w < m_words; ++w) n += count_bits(m_playing[w]);
+  return n;
+}
+
+
+bool LakeBatch::playing(int board) const
+{
+  check_board(board);
+  return m_playing[board/lanebits] & bit(board);
+}
+
+
+bool LakeBatch::lost(int board) const
+{
+  check_board(board);
+  return m_lost[board/lanebits] & bit(board);
+}
+
+
+int LakeBatch::moves(int board) const
+{
+  check_board(board);
+  return m_moves[board];
+}
+
+
+int LakeBatch::to_go(int board) const
+{
+  check_board(board);
+  const int w = board / lanebits;
+  const Lanes b = bit(board);
+  int n = 0;
+  for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+  {
+    const int k = index_for(r,c);
+    n += !((plane(m_revealed,k)[w] | plane(m_mined,k)[w]) & b);
+  }
+  return n;
+}
+
+
+char LakeBatch::status_at(int board, int row, int col) const
+{
+  check_board(board);
+  check_pos(row, col);
+  const int k = index_for(row,col), w = board / lanebits, stride = m_cols + 2;
+  const Lanes b = bit(board);
+  if (!(plane(m_revealed,k)[w] & b)) return '^';
+  if (plane(m_mined,k)[w] & b) return '*';
+
+  int n = 0;
+  for (int dr = -stride; dr <= stride; dr += stride)
+    for (int dc = -1; dc <= 1; ++dc)
+      n += !!(plane(m_mined,k+dr+dc)[w] & b);
+  return '0' + n;
+}
+
+
+void LakeBatch::status(int row, int col, char out[]) const
+{
+  for (int b = 0; b < m_boards; ++b) out[b] = status_at(b, row, col);
+}
+
+
+void LakeBatch::probe(int row, int col)
+{
+  check_pos(row, col);
+  const int k = index_for(row,col);
+  for (int w = 0; w < m_words; ++w)
+    reveal(k, w, m_playing[w] & ~plane(m_revealed,k)[w]);
+  settle();
+}
+
+
+void LakeBatch::probe(const Coords moves[])
+{
+  // Check all moves first, so a bad one doesn't leave the batch half-done
+  for (int b = 0; b < m_boards; ++b)
+    if (m_playing[b/lanebits] & bit(b)) check_pos(moves[b].row, moves[b].col);
+
+  for (int b = 0; b < m_boards; ++b)
+  {
+    const int w = b / lanebits;
+    if (!(m_playing[w] & bit(b))) continue;
+    const int k = index_for(moves[b].row, moves[b].col);
+    reveal(k, w, bit(b) & ~plane(m_revealed,k)[w]);
+  }
+  settle();
+}
+
+
+void LakeBatch::reveal(int k, int w, Lanes mask) throw ()
+{
+  if (!mask) return;
+
+  plane(m_revealed,k)[w] |= mask;
+  const Lanes boom = mask & plane(m_mined,k)[w];
+  m_lost[w] |= boom;
+  m_playing[w] &= ~boom;
+
+  // Count a move for each board, lowest bit first
+  for (Lanes m = mask; m; m &= m-1)
+    ++m_moves[w*lanebits + count_bits((m & (~m+1)) - 1)];
+}
+
+
+bool LakeBatch::flood_pass(bool backwards) throw ()
+{
+  const int stride = m_cols + 2;
+  const int offsets[] =
+	{ -stride-1, -stride, -stride+1, -1, 1, stride-1, stride, stride+1 };
+  const int first = index_for(0,0), last = index_for(m_rows-1,m_cols-1);
+  const int active = int(m_active.size());
+
+  Lanes changed = 0;
+  for (int i = first; i <= last; ++i)
+  {
+    const int k = backwards ? first+last-i : i;
+    const Lanes *const rev = plane(m_revealed,k),
+		*const empty = plane(m_empty,k);
+    Lanes *const flooded = plane(m_flooded,k);
+    for (int a = 0; a < active; ++a)
+    {
+      const int w = m_active[a];
+      const Lanes spread = rev[w] & empty[w] & ~flooded[w] & m_playing[w];
+      if (!spread) continue;
+      flooded[w] |= spread;
+      for (int n = 0; n < 8; ++n)
+      {
+	Lanes &r = plane(m_revealed, k+offsets[n])[w];
+	changed |= spread & ~r;
+	r |= spread;
+      }
+    }
+  }
+  return changed;
+}
+
+
+void LakeBatch::settle() throw ()
+{
+  // Only words holding boards that are still in play need any work
+  m_active.clear();
+  for (int w = 0; w < m_words; ++w) if (m_playing[w]) m_active.push_back(w);
+
+  // Flood alternately forwards and backwards, until nothing changes
+  if (m_intelligence > 0)
+    for (bool backwards = false; flood_pass(backwards); backwards = !backwards)
+      ;
+
+  // Boards that have no unexplored clear patches left are won
+  for (size_t a = 0; a < m_active.size(); ++a)
+  {
+    const int w = m_active[a];
+    Lanes remaining = 0;
+    for (int r = 0; r < m_rows; ++r)
+    {
+      const int k = index_for(r,0);
+      const Lanes *const rev = plane(m_revealed,k),
+		  *const mined = plane(m_mined,k);
+      for (int c = 0; c < m_cols; ++c)
+	remaining |= ~(rev[c*m_words+w] | mined[c*m_words+w]);
+    }
+    m_playing[w] &= remaining;
+  }
+}
+
+
+void LakeBatch::check_board(int board) const
+{
+  if (board < 0 || board >= m_boards)
+    throw out_of_range("Board number out of range");
+}
+
+
+void LakeBatch::check_pos(int row, int col) const
+{
+  if (row < 0 || row >= m_rows || col < 0 || col >= m_cols)
+    throw out_of_range("Position outside playing field");
+}
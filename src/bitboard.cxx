@@ -0,0 +1,291 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+// Working out everything that's obvious, for a whole square field at once.
+
+#include "bitboard.hxx"
+
+using namespace std;
+
+
+namespace
+{
+typedef uint64_t Word;
+
+/// Patches whose western neighbour is marked in row x, at word w
+inline Word from_west(const Word x[], int w) throw ()
+{
+  return (x[w] << 1) | (w ? x[w-1] >> 63 : 0);
+}
+
+/// Patches whose eastern neighbour is marked in row x, at word w
+inline Word from_east(const Word x[], int w, int words) throw ()
+{
+  return (x[w] >> 1) | (w+1 < words ? x[w+1] << 63 : 0);
+}
+
+
+/// Bit-sliced 4-bit counter: one count for each bit position in a word
+struct Counter
+{
+  Word b0, b1, b2, b3;
+
+  Counter() : b0(0), b1(0), b2(0), b3(0) {}
+
+  /// Add one to the counts at the positions set in x
+  void add(Word x) throw ()
+  {
+    Word carry = b0 & x;
+    b0 ^= x;
+    x = carry;
+    carry = b1 & x;
+    b1 ^= x;
+    x = carry;
+    carry = b2 & x;
+    b2 ^= x;
+    b3 |= carry;
+  }
+
+  /// Add up the neighbours, within rows above, here, and below, at word w
+  void add_neighbours(const Word above[],
+	const Word here[],
+	const Word below[],
+	int w,
+	int words) throw ()
+  {
+    add(from_west(above,w));
+    add(above[w]);
+    add(from_east(above,w,words));
+    add(from_west(here,w));
+    add(from_east(here,w,words));
+    add(from_west(below,w));
+    add(below[w]);
+    add(from_east(below,w,words));
+  }
+
+  Word nonzero() const throw () { return b0 | b1 | b2 | b3; }
+  Word equals(const Counter &rhs) const throw ()
+  {
+    return ~((b0 ^ rhs.b0) | (b1 ^ rhs.b1) | (b2 ^ rhs.b2) | (b3 ^ rhs.b3));
+  }
+};
+} // namespace
+
+
+BitBoard::BitBoard(int rows, int cols) :
+  m_rows(rows),
+  m_cols(cols),
+  m_words((cols + wordbits-1) / wordbits),
+  m_field(m_words, ~Word(0)),
+  m_mined((rows+2)*m_words, 0),
+  m_unknown((rows+2)*m_words, 0),
+  m_zero((rows+2)*m_words, 0),
+  m_obvious(m_words, 0),
+  m_changed(rows+2, 0),
+  m_checked(rows+2, -1),
+  m_step(0)
+{
+  if (cols % wordbits) m_field[m_words-1] = bit(cols) - 1;
+  for (int r = 0; r < rows; ++r)
+    copy(m_field.begin(), m_field.end(), row(m_unknown,r));
+}
+
+
+void BitBoard::find_zeroes()
+{
+  for (int r = 0; r < m_rows; ++r)
+  {
+    Word *const zero = row(m_zero,r);
+    const Word *const above = row(m_mined,r-1),
+	       *const here = row(m_mined,r),
+	       *const below = row(m_mined,r+1);
+    for (int w = 0; w < m_words; ++w)
+    {
+      const Word mines = above[w] | here[w] | below[w];
+      zero[w] = m_field[w] & ~(mines | (mines << 1) | (mines >> 1));
+    }
+    // Mines in the next or previous word spill over the word boundary
+    for (int w = 0; w < m_words; ++w)
+    {
+      const Word mines = above[w] | here[w] | below[w];
+      if (w) zero[w-1] &= ~(mines << 63);
+      if (w+1 < m_words) zero[w+1] &= ~(mines >> 63);
+    }
+  }
+}
+
+
+bool BitBoard::flood_row(int r)
+{
+  const Word *const zero = row(m_zero,r), *const unknown = row(m_unknown,r);
+  Word *const flood = &m_obvious[0];
+
+  /* Revealed zeroes reveal the patches next to them, so each run of zeroes
+   * that has one revealed patch in it gets revealed completely.  Fill each
+   * such run from its revealed patches, both ways, a word at a time, carrying
+   * over word boundaries.
+   */
+  Word any = 0;
+  for (int w = 0; w < m_words; ++w) any |= (flood[w] = zero[w] & ~unknown[w]);
+  if (!any) return false;
+
+  Word carry = 0;
+  for (int w = 0; w < m_words; ++w)
+  {
+    Word g = flood[w] | (carry & zero[w]), p = zero[w];
+    g |= p & (g << 1);
+    p &= p << 1;
+    g |= p & (g << 2);
+    p &= p << 2;
+    g |= p & (g << 4);
+    p &= p << 4;
+    g |= p & (g << 8);
+    p &= p << 8;
+    g |= p & (g << 16);
+    p &= p << 16;
+    g |= p & (g << 32);
+    flood[w] = g;
+    carry = g >> 63;
+  }
+  carry = 0;
+  for (int w = m_words-1; w >= 0; --w)
+  {
+    Word g = flood[w] | ((carry << 63) & zero[w]), p = zero[w];
+    g |= p & (g >> 1);
+    p &= p >> 1;
+    g |= p & (g >> 2);
+    p &= p >> 2;
+    g |= p & (g >> 4);
+    p &= p >> 4;
+    g |= p & (g >> 8);
+    p &= p >> 8;
+    g |= p & (g >> 16);
+    p &= p >> 16;
+    g |= p & (g >> 32);
+    flood[w] = g;
+    carry = g & 1;
+  }
+  return reveal_around(r, flood);
+}
+
+
+bool BitBoard::find_obvious(int r)
+{
+  const Word *const mined = row(m_mined,r), *const unknown = row(m_unknown,r);
+  const Word *const above = row(m_unknown,r-1),
+	     *const below = row(m_unknown,r+1);
+  const Word *const mabove = row(m_mined,r-1), *const mbelow = row(m_mined,r+1);
+
+  Word any = 0;
+  for (int w = 0; w < m_words; ++w)
+  {
+    const Word candidates = m_field[w] & ~unknown[w] & ~mined[w];
+    if (!candidates)
+    {
+      m_obvious[w] = 0;
+      continue;
+    }
+
+    // Count unexplored neighbours, and unexplored mined ones
+    Counter hidden, unexplored;
+    unexplored.add_neighbours(above, unknown, below, w, m_words);
+    Word a[3], h[3], b[3];
+    const int lo = w ? w-1 : w, hi = w+1 < m_words ? w+1 : w;
+    for (int i = lo; i <= hi; ++i)
+    {
+      a[i-w+1] = above[i] & mabove[i];
+      h[i-w+1] = unknown[i] & mined[i];
+      b[i-w+1] = below[i] & mbelow[i];
+    }
+    if (lo == w) a[0] = h[0] = b[0] = 0;
+    if (hi == w) a[2] = h[2] = b[2] = 0;
+    hidden.add_neighbours(a, h, b, 1, 3);
+
+    m_obvious[w] = candidates & unexplored.nonzero() &
+	(~hidden.nonzero() | hidden.equals(unexplored));
+    any |= m_obvious[w];
+  }
+  return any;
+}
+
+
+bool BitBoard::reveal_around(int r, const Word spread[])
+{
+  bool changed = false;
+  for (int dr = -1; dr <= 1; ++dr)
+  {
+    if (r+dr < 0 || r+dr >= m_rows) continue;
+    Word *const unknown = row(m_unknown,r+dr);
+    bool touched = false;
+    for (int w = 0; w < m_words; ++w)
+    {
+      const Word reach = spread[w] |
+	from_west(spread,w) | from_east(spread,w,m_words);
+      const Word found = reach & unknown[w];
+      if (!found) continue;
+      unknown[w] &= ~found;
+      touched = true;
+    }
+    if (touched)
+    {
+      touch(r+dr);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+
+bool BitBoard::settle_row(int r)
+{
+  bool changed = false;
+  for (;;)
+  {
+    const bool flooded = flood_row(r);
+    if (!find_obvious(r) || !reveal_around(r, &m_obvious[0]))
+    {
+      changed = changed || flooded;
+      if (!flooded) break;
+    }
+    else
+    {
+      changed = true;
+    }
+  }
+  m_checked[r+1] = m_step;
+  return changed;
+}
+
+
+void BitBoard::solve()
+{
+  find_zeroes();
+  for (bool down = true, changed = true; changed; down = !down)
+  {
+    changed = false;
+    for (int i = 0; i < m_rows; ++i)
+    {
+      const int r = down ? i : m_rows-1-i;
+      const long last = max(m_changed[r], max(m_changed[r+1], m_changed[r+2]));
+      if (m_checked[r+1] >= last) continue;
+      if (settle_row(r)) changed = true;
+    }
+  }
+}
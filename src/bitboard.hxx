@@ -0,0 +1,93 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#include <vector>
+#include <stdint.h>
+
+/// Square playing field as planes of bits, to work out what's obvious in bulk
+/** Each row of the field takes a whole number of 64-bit words in each plane,
+ * with the patch in column c at bit c%64 of word c/64.  There is an empty row
+ * above and below the field, so every row has neighbours on both sides.  One
+ * plane says which patches are mined, another which are still unexplored.
+ *
+ * solve() applies the rule of intelligence level 2 to the whole field: a
+ * revealed, clear patch whose unexplored neighbours are either all clear or
+ * all mined gets all of them revealed.  It works on a whole row at a time, 64
+ * patches to a word, counting each patch's unexplored and mined neighbours in
+ * bit-sliced counters.  Runs of patches with no mines around them are flooded
+ * along the row in one go.  It sweeps down and up the field until nothing
+ * changes, skipping rows whose surroundings haven't changed since they were
+ * last looked at.
+ */
+class BitBoard
+{
+public:
+  /// Set up field with no mines, and nothing revealed
+  BitBoard(int rows, int cols);
+
+  void set_mined(int row, int col) throw ()
+	{ m_mined[word_for(row,col)] |= bit(col); }
+  void set_revealed(int row, int col) throw ()
+	{ m_unknown[word_for(row,col)] &= ~bit(col); }
+  bool revealed(int row, int col) const throw ()
+	{ return !(m_unknown[word_for(row,col)] & bit(col)); }
+
+  /// Reveal whatever has become obvious, until nothing more is
+  void solve();
+
+private:
+  typedef uint64_t Word;
+  enum { wordbits = 64 };
+
+  int word_for(int row, int col) const throw ()
+	{ return (row+1)*m_words + col/wordbits; }
+  static Word bit(int col) throw () { return Word(1) << (col % wordbits); }
+
+  /// Row of given plane, with -1 and rows() being the empty rows around it
+  Word *row(std::vector<Word> &plane, int r) throw ()
+	{ return &plane[(r+1)*m_words]; }
+
+  /// Work out which patches have no mines around them
+  void find_zeroes();
+  /// Reveal what has become obvious around row r; true if anything changed
+  bool settle_row(int r);
+  /// Flood row r's revealed zeroes along the row; true if anything changed
+  bool flood_row(int r);
+  /// Reveal unexplored neighbours of patches in row r marked in spread
+  bool reveal_around(int r, const Word spread[]);
+  /// Mark patches in row r that are obvious, in m_obvious
+  bool find_obvious(int r);
+  /// Note that row r has changed
+  void touch(int r) throw () { m_changed[r+1] = ++m_step; }
+
+  int m_rows, m_cols, m_words;
+  /// Mask of the patches in a row that are actually in the field
+  std::vector<Word> m_field;
+  std::vector<Word> m_mined, m_unknown;
+  /// Clear patches that have no mines around them
+  std::vector<Word> m_zero;
+  /// Scratch row: patches found to be obvious, or flooded
+  std::vector<Word> m_obvious;
+  /// Per row, including empty ones: step at which it last changed
+  std::vector<long> m_changed;
+  /// Per row: step at which it was last found to have nothing obvious left
+  std::vector<long> m_checked;
+  long m_step;
+};
@@ -17,8 +17,14 @@ libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
 Suite 330, Boston, MA  02111-1307  USA
 */
 #include <set>
+#include <vector>
 
+#include "archive.hxx"
+#include "batch.hxx"
 #include "gamelogic.hxx"
+#include "gametable.hxx"
+#include "replay.hxx"
+#include "savequeue.hxx"
 #include "c_abi.h"
 
 using namespace std;
@@ -34,6 +40,100 @@ const Lake *castback(const Minefield *f)
 {
   return static_cast<const Lake *>(f);
 }
+
+LakePool *poolcast(MinesPool *p)
+{
+  return static_cast<LakePool *>(p);
+}
+
+GameTable *tablecast(MinesTable *t)
+{
+  return static_cast<GameTable *>(t);
+}
+
+LakeBatch *batchcast(MinesBatch *b)
+{
+  return static_cast<LakeBatch *>(b);
+}
+
+const LakeBatch *batchcast(const MinesBatch *b)
+{
+  return static_cast<const LakeBatch *>(b);
+}
+
+GameArchive *archivecast(MinesArchive *a)
+{
+  return static_cast<GameArchive *>(a);
+}
+
+SaveQueue *queuecast(MinesSaveQueue *q)
+{
+  return static_cast<SaveQueue *>(q);
+}
+
+MoveLog *logcast(MinesLog *l)
+{
+  return static_cast<MoveLog *>(l);
+}
+
+const MoveLog *logcast(const MinesLog *l)
+{
+  return static_cast<const MoveLog *>(l);
+}
+
+/// Translate outcome of a probe to mines_probe() return value
+template<typename FUNCT> int probe_result(FUNCT f)
+{
+  try
+  {
+    if (!f()) return -1;
+  }
+  catch (const Boom &)
+  {
+    return 0;
+  }
+  catch (const exception &)
+  {
+    return -1;
+  }
+  return 1;
+}
+
+/// Functor: probe Lake, returning true
+class lake_prober
+{
+public:
+  lake_prober(Lake &L, int row, int col, bool as_mine) :
+    m_lake(L), m_row(row), m_col(col), m_mine(as_mine) {}
+  bool operator()() const
+  {
+    set<Coords> changes;
+    m_lake.probe(m_row,m_col,changes,m_mine);
+    return true;
+  }
+private:
+  Lake &m_lake;
+  int m_row, m_col;
+  bool m_mine;
+};
+
+/// Functor: probe game in GameTable, returning whether it was found
+class table_prober
+{
+public:
+  table_prober(GameTable &T, uint64_t id, int row, int col, bool as_mine) :
+    m_table(T), m_id(id), m_row(row), m_col(col), m_mine(as_mine) {}
+  bool operator()() const
+  {
+    set<Coords> changes;
+    return m_table.probe(m_id,m_row,m_col,changes,m_mine);
+  }
+private:
+  GameTable &m_table;
+  uint64_t m_id;
+  int m_row, m_col;
+  bool m_mine;
+};
 } // namespace
 
 extern "C"
@@ -44,6 +144,100 @@ Minefield *mines_init(int rows, int cols, int mines)
 }
 
 
+Minefield *mines_init_seeded(int rows, int cols, int mines, unsigned long seed)
+{
+  return new Lake(rows, cols, mines, seed);
+}
+
+
+Minefield *mines_init_topology(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	int topology)
+{
+  if (topology < MINES_SQUARE || topology > MINES_KNIGHT) return 0;
+  try
+  {
+    return new Lake(rows, cols, mines, seed, Topology(topology));
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+int mines_topology(const Minefield *f)
+{
+  return castback(f)->topology();
+}
+
+
+Minefield *mines_init_layout(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	int layout)
+{
+  if (layout < MINES_ROW_MAJOR || layout > MINES_BLOCKED) return 0;
+  try
+  {
+    return new Lake(rows, cols, mines, seed, square_topology, Layout(layout));
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+Minefield *mines_init_tiled(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	int threads)
+{
+  Lake *L = 0;
+  try
+  {
+    L = new Lake(1, 1, 0, seed);
+    L->reset_tiled(rows, cols, mines, seed, threads);
+  }
+  catch (const exception &)
+  {
+    delete L;
+    L = 0;
+  }
+  return L;
+}
+
+
+Minefield *mines_init_solvable(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	int first_row,
+	int first_col,
+	int intelligence,
+	int threads)
+{
+  Lake *L = 0;
+  try
+  {
+    L = new Lake(rows, cols, 0, seed);
+    L->reset_solvable(rows, cols, mines, seed, Coords(first_row,first_col),
+	intelligence, threads);
+  }
+  catch (const exception &)
+  {
+    delete L;
+    L = 0;
+  }
+  return L;
+}
+
+
 Minefield *mines_load(const char buffer[])
 {
   return new Lake(buffer);
@@ -56,6 +250,88 @@ void mines_close(Minefield *f)
 }
 
 
+MinesPool *mines_pool_create()
+{
+  try
+  {
+    return new LakePool;
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+void mines_pool_destroy(MinesPool *p)
+{
+  delete poolcast(p);
+}
+
+
+Minefield *mines_pool_init(MinesPool *p, int rows, int cols, int mines)
+{
+  try
+  {
+    return poolcast(p)->create(rows, cols, mines);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+Minefield *mines_pool_init_seeded(MinesPool *p,
+	int rows,
+	int cols,
+	int mines,
+	unsigned long seed)
+{
+  try
+  {
+    return poolcast(p)->create(rows, cols, mines, seed);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+Minefield *mines_pool_load(MinesPool *p, const char buffer[])
+{
+  try
+  {
+    return poolcast(p)->load(buffer);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+void mines_pool_close(MinesPool *p, Minefield *f)
+{
+  poolcast(p)->destroy(castback(f));
+}
+
+
+int mines_reset(Minefield *f, int rows, int cols, int mines)
+{
+  try
+  {
+    castback(f)->reset(rows, cols, mines);
+  }
+  catch (const exception &)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
 int mines_savesize(const Minefield *f)
 {
   return castback(f)->savesize();
@@ -68,6 +344,371 @@ int mines_save(Minefield *f, char buffer[])
 }
 
 
+int mines_reset_seeded(Minefield *f, int rows, int cols, int mines,
+	unsigned long seed)
+{
+  try
+  {
+    castback(f)->reset(rows, cols, mines, seed);
+  }
+  catch (const exception &)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+MinesTable *mines_table_create(int shards)
+{
+  try
+  {
+    return new GameTable(shards);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+void mines_table_destroy(MinesTable *t)
+{
+  delete tablecast(t);
+}
+
+
+int mines_table_insert(MinesTable *t, unsigned long long id, Minefield *f)
+{
+  try
+  {
+    return tablecast(t)->insert(id, castback(f));
+  }
+  catch (const exception &)
+  {
+  }
+  return -1;
+}
+
+
+Minefield *mines_table_remove(MinesTable *t, unsigned long long id)
+{
+  return tablecast(t)->remove(id);
+}
+
+
+int mines_table_probe(MinesTable *t,
+	unsigned long long id,
+	int row,
+	int col,
+	int minedP)
+{
+  return probe_result(table_prober(*tablecast(t), id, row, col, minedP));
+}
+
+
+MinesBatch *mines_batch_create(int boards, int rows, int cols)
+{
+  try
+  {
+    return new LakeBatch(boards, rows, cols);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+void mines_batch_destroy(MinesBatch *b)
+{
+  delete batchcast(b);
+}
+
+
+int mines_batch_reset(MinesBatch *b, int mines, unsigned long seed)
+{
+  try
+  {
+    batchcast(b)->reset(mines, seed);
+  }
+  catch (const exception &)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+int mines_batch_probe_all(MinesBatch *b, int row, int col)
+{
+  try
+  {
+    batchcast(b)->probe(row, col);
+    return batchcast(b)->playing();
+  }
+  catch (const exception &)
+  {
+  }
+  return -1;
+}
+
+
+int mines_batch_probe(MinesBatch *b, const int rows[], const int cols[])
+{
+  try
+  {
+    LakeBatch &B = *batchcast(b);
+    vector<Coords> moves;
+    moves.reserve(B.boards());
+    for (int i = 0; i < B.boards(); ++i)
+      moves.push_back(Coords(rows[i], cols[i]));
+    B.probe(&moves[0]);
+    return B.playing();
+  }
+  catch (const exception &)
+  {
+  }
+  return -1;
+}
+
+
+int mines_batch_state(const MinesBatch *b, int board)
+{
+  try
+  {
+    const LakeBatch &B = *batchcast(b);
+    if (B.playing(board)) return 0;
+    return B.lost(board) ? 2 : 1;
+  }
+  catch (const exception &)
+  {
+  }
+  return -1;
+}
+
+
+char mines_batch_at(const MinesBatch *b, int board, int row, int col)
+{
+  try
+  {
+    return batchcast(b)->status_at(board, row, col);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+MinesArchive *mines_archive_open(const char path[], int durable)
+{
+  try
+  {
+    return new GameArchive(path, durable);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+void mines_archive_close(MinesArchive *a)
+{
+  delete archivecast(a);
+}
+
+
+Minefield *mines_archive_load(MinesArchive *a, unsigned long long id)
+{
+  try
+  {
+    return archivecast(a)->load(id);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+int mines_archive_store(MinesArchive *a, unsigned long long id,
+	const Minefield *f)
+{
+  try
+  {
+    archivecast(a)->store(id, *castback(f));
+  }
+  catch (const exception &)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+int mines_archive_remove(MinesArchive *a, unsigned long long id)
+{
+  try
+  {
+    return archivecast(a)->remove(id);
+  }
+  catch (const exception &)
+  {
+  }
+  return -1;
+}
+
+
+long long mines_archive_size(MinesArchive *a)
+{
+  try
+  {
+    return archivecast(a)->size();
+  }
+  catch (const exception &)
+  {
+  }
+  return -1;
+}
+
+
+int mines_archive_compact(MinesArchive *a)
+{
+  try
+  {
+    archivecast(a)->compact();
+  }
+  catch (const exception &)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+MinesSaveQueue *mines_queue_open(const char path[], int durable)
+{
+  try
+  {
+    return new SaveQueue(path, durable);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+void mines_queue_close(MinesSaveQueue *q)
+{
+  delete queuecast(q);
+}
+
+
+int mines_queue_store(MinesSaveQueue *q, unsigned long long id,
+	const Minefield *f)
+{
+  try
+  {
+    queuecast(q)->store(id, *castback(f));
+  }
+  catch (const exception &)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+int mines_queue_flush(MinesSaveQueue *q)
+{
+  try
+  {
+    queuecast(q)->flush();
+  }
+  catch (const exception &)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+
+MinesLog *mines_log_start(Minefield *f, int checkpoint_interval)
+{
+  MoveLog *L = 0;
+  try
+  {
+    L = new MoveLog(checkpoint_interval);
+    castback(f)->record(L);
+  }
+  catch (const exception &)
+  {
+    delete L;
+    L = 0;
+  }
+  return L;
+}
+
+
+void mines_log_stop(Minefield *f)
+{
+  castback(f)->record(0);
+}
+
+
+void mines_log_close(MinesLog *l)
+{
+  delete logcast(l);
+}
+
+
+int mines_log_moves(const MinesLog *l)
+{
+  return logcast(l)->moves();
+}
+
+
+int mines_log_savesize(const MinesLog *l)
+{
+  return logcast(l)->savesize();
+}
+
+
+int mines_log_save(const MinesLog *l, char buffer[])
+{
+  return logcast(l)->save(buffer);
+}
+
+
+MinesLog *mines_log_load(const char buffer[])
+{
+  try
+  {
+    return new MoveLog(buffer);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
+Minefield *mines_replay(const MinesLog *l, int verify)
+{
+  try
+  {
+    return logcast(l)->replay(verify);
+  }
+  catch (const exception &)
+  {
+  }
+  return 0;
+}
+
+
 int mines_max_intelligence()
 {
   return Lake::max_intelligence();
@@ -80,22 +721,38 @@ void mines_set_intelligence(Minefield *f, int i)
 }
 
 
-int mines_probe(Minefield *f, int row, int col, int minedP)
+int mines_index_openings(Minefield *f, int on)
 {
   try
   {
-    set<Coords> changes;
-    castback(f)->probe(row,col,changes,minedP);
+    castback(f)->index_openings(on != 0);
   }
-  catch (const Boom &)
+  catch (const exception &)
   {
-    return 0;
+    return -1;
+  }
+  return 0;
+}
+
+
+int mines_probe(Minefield *f, int row, int col, int minedP)
+{
+  return probe_result(lake_prober(*castback(f), row, col, minedP));
+}
+
+
+int mines_solve_obvious(Minefield *f)
+{
+  try
+  {
+    set<Coords> changes;
+    castback(f)->solve_obvious(changes);
+    return int(changes.size());
   }
   catch (const exception &)
   {
-    return -1;
   }
-  return 1;
+  return -1;
 }
 
 
@@ -109,6 +766,73 @@ char mines_at(const Minefield *f, int row, int col)
   return castback(f)->status_at(row,col);
 }
 
+int mines_hint(Minefield *f, int *row, int *col)
+{
+  try
+  {
+    Hint h;
+    if (!castback(f)->hint(h)) return -1;
+    *row = h.position.row;
+    *col = h.position.col;
+    return h.safe;
+  }
+  catch (const exception &)
+  {
+  }
+  return -1;
+}
+
+int mines_metrics(const Minefield *f,
+	int *openings,
+	int *isolated,
+	int sizes[],
+	int max_sizes)
+{
+  try
+  {
+    BoardMetrics m;
+    castback(f)->metrics(m);
+    if (openings) *openings = m.openings;
+    if (isolated) *isolated = m.isolated;
+    if (sizes)
+      for (int i = 0; i < m.openings && i < max_sizes; ++i)
+	sizes[i] = m.opening_sizes[i];
+    return m.bbbv;
+  }
+  catch (const exception &)
+  {
+  }
+  return -1;
+}
+
+int mines_frontier_numbers(const Minefield *f)
+{
+  return castback(f)->frontier_numbers();
+}
+
+int mines_frontier_unknowns(const Minefield *f)
+{
+  return castback(f)->frontier_unknowns();
+}
+
+int mines_frontier_number(const Minefield *f, int i, int *row, int *col)
+{
+  if (i < 0 || i >= castback(f)->frontier_numbers()) return -1;
+  const Coords pos = castback(f)->frontier_number(i);
+  *row = pos.row;
+  *col = pos.col;
+  return 0;
+}
+
+int mines_frontier_unknown(const Minefield *f, int i, int *row, int *col)
+{
+  if (i < 0 || i >= castback(f)->frontier_unknowns()) return -1;
+  const Coords pos = castback(f)->frontier_unknown(i);
+  *row = pos.row;
+  *col = pos.col;
+  return 0;
+}
+
 int mines_togo(const Minefield *f)
 {
   return castback(f)->to_go();
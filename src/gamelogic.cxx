@@ -19,125 +19,85 @@ Suite 330, Boston, MA  02111-1307  USA
 
 // This is is where heart of the game is implemented.
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitboard.hxx"
 #include "gamelogic.hxx"
+#include "replay.hxx"
+#include "hint.hxx"
+#include "random.hxx"
 #include "save.hxx"
 
 using namespace std;
 
 
-#include<iostream>// DEBUG CODE
 namespace
 {
-int rand_coord(int top)
+
+/// Functor to apply to neighbouring Patches when initializing a mine
+struct set_nearby_mine
 {
-  // TODO: There's probably some better random function out there
-  return rand() % top;
-}
-} // namespace
+  void operator()(Coords, Patch &p) const { p.set_nearby_mine(); }
+};
 
+/// Size of the tiles that Lake::reset_tiled() works in; changes its games
+enum { tile_size = 256 };
 
-/// A square patch of water, which may or may not contain a mine
-class Patch
+/// Like set_nearby_mine, but only inside (or only outside) a tile
+/** Notes in "skipped" whether it left out any neighbours.
+ */
+class set_tile_nearby_mine
 {
 public:
-  Patch();
-
-  /// Initialization: set a mine
-  void mine();
-
-  bool mined() const throw () { return m_mined; }
-  bool revealed() const throw () { return m_revealed; }
-  int near_mines() const throw () { return m_nearmines; }
-  int near_hiddenmines() const throw () { return m_near_hiddenmines; }
-  int near_unknown() const throw () { return m_near_unknown; }
-
-  void reveal() throw () { m_revealed = true; }
-
-  /// Initialization: mark the fact that a mine has been set in a nearby Patch
-  void set_nearby_mine();
-
-  /// Adjust to revelation of nearby Patch (mined or not, depending on argument)
-  void reveal_nearby(bool is_mined);
-
-  /// Should the state of all nearby Patches now be obvious to the user?
-  bool obvious() const throw ();
+  set_tile_nearby_mine(int top, int left, bool inside, bool &skipped) :
+    m_top(top), m_left(left), m_inside(inside), m_skipped(skipped) {}
+  void operator()(Coords c, Patch &p) const
+  {
+    const bool in = c.row >= m_top && c.row < m_top + tile_size &&
+	c.col >= m_left && c.col < m_left + tile_size;
+    if (in == m_inside) p.set_nearby_mine();
+    else m_skipped = true;
+  }
 
 private:
-  int m_nearmines;
-  int m_near_hiddenmines;
-  /// Nearby unrevealed patches (not correct for border patches, but who cares)
-  int m_near_unknown;
-  bool m_mined;
-  bool m_revealed;
+  int m_top, m_left;
+  bool m_inside;
+  bool &m_skipped;
 };
 
-
-Patch::Patch() :
-  m_nearmines(0),
-  m_near_hiddenmines(0),
-  m_near_unknown(8),
-  m_mined(false),
-  m_revealed(false)
-{
-}
-
-void Patch::mine()
-{
-  assert(!mined());
-  m_mined = true;
-  assert(mined());
-}
-
-void Patch::set_nearby_mine()
-{
-  ++m_nearmines;
-  ++m_near_hiddenmines;
-  assert(m_nearmines <= 8);
-  assert(m_near_hiddenmines <= m_nearmines);
-}
-
-void Patch::reveal_nearby(bool is_mined)
-{
-  m_near_hiddenmines -= is_mined;
-  --m_near_unknown;
-
-  assert(m_near_hiddenmines >= 0);
-  assert(m_near_unknown >= 0);
-  assert(m_near_hiddenmines <= m_near_unknown);
-}
-
-bool Patch::obvious() const throw ()
-{
-  return near_unknown() && revealed() && !mined() &&
-    (!near_hiddenmines() || near_hiddenmines()==near_unknown());
-}
-
-
-namespace
-{
-
-/// Functor to apply to neighbouring Patches when initializing a mine
-struct set_nearby_mine
+/// Functor to apply to neighbouring Patches when removing a mine
+struct unset_nearby_mine
 {
-  void operator()(Coords, Patch &p) const { p.set_nearby_mine(); }
+  void operator()(Coords, Patch &p) const { p.unset_nearby_mine(); }
 };
 
-/// Functor: note that nearby patch has been revealed, update counters
-class reveal_nearby
+/// Functor to apply to neighbouring Patches when loading a saved game
+class load_nearby
 {
 public:
-  explicit reveal_nearby(bool mined) : m_mine(mined) {}
-  void operator()(Coords, Patch &p) const { p.reveal_nearby(m_mine); }
+  load_nearby(bool mined, bool revealed) :
+    m_mined(mined), m_revealed(revealed) {}
+  void operator()(Coords, Patch &p) const
+	{ p.load_nearby(m_mined, m_revealed); }
 
 private:
-  bool m_mine;
-
-  reveal_nearby();
+  bool m_mined, m_revealed;
 };
 
 /// Functor: add element to set if it satisfies given condition functor
@@ -185,288 +145,2516 @@ struct CoordsPair
 };
 
 
-bool are_neighbours(Coords a, Coords b)
+/// Functor: add up the space taken by a series of varints
+class varint_counter
 {
-  return abs(a.row-b.row) <= 1 && abs(a.col-b.col) <= 1;
-}
-
-} // namespace
+public:
+  varint_counter() : m_values(0), m_chars(0) {}
+  void operator()(unsigned long val) throw ()
+  {
+    ++m_values;
+    m_chars += varint_size(val);
+  }
+  int values() const throw () { return m_values; }
+  int chars() const throw () { return m_chars; }
+private:
+  int m_values, m_chars;
+};
 
 
-Lake::Lake(int _rows, int _cols, int mines) :
-  m_patches(0),
-  m_rows(_rows),
-  m_cols(_cols),
-  m_intelligence(1),
-  m_patches_to_go(m_rows*m_cols),
-  m_moves(0)
+/// Functor: write a series of varints
+class varint_writer
 {
-  init_field();
+public:
+  explicit varint_writer(char *&here) : m_here(here) {}
+  void operator()(unsigned long val) { m_here = write_varint(m_here, val); }
+private:
+  char *&m_here;
+};
 
-  while (mines)
-  {
-    const int row = rand_coord(m_rows), col = rand_coord(m_cols);
-    mines -= place_mine_at(row,col);
-  }
-}
 
+/// Room for everything in a saved game but its data, whatever the values
+/** That's the format line; up to seven lines of a four-letter key, a space,
+ * an int of up to 11 characters, and a newline; three empty lines; and the
+ * terminating zero.
+ */
+enum { header_room = 11 + 7*(4+1+11+1) + 3 + 1 };
 
-Lake::Lake(const char buffer[]) :
-  m_patches(0),
-  m_rows(0),
-  m_cols(0),
-  m_intelligence(0),
-  m_patches_to_go(0),
-  m_moves(0)
+
+/// Bytes needed to save game in dense format
+int dense_size(int rows, int cols) throw ()
 {
-  initialize_encoding();
+  return rows * ((cols+patchesperchar-1)/patchesperchar+3) + header_room;
+}
 
-  const char *here = read_header(buffer);
 
-  m_rows = read_int("rows",here);
-  m_cols = read_int("cols",here);
-  m_moves = read_int("move",here);
-  m_intelligence = read_int("intl",here);
-  m_patches_to_go = m_rows * m_cols;
+/// Bytes needed to save game in sparse format
+int sparse_size(const varint_counter &mines, const varint_counter &reveals)
+	throw ()
+{
+  return mines.chars() + reveals.chars() + header_room;
+}
 
-  init_field();
 
-  here = skip_whitespace(here);
+/// Identifies a mapped game file, as documented with MappedLake
+const char map_magic[8] = { 'm', 'i', 'n', 'e', 's', 'm', 'a', 'p' };
+const uint32_t map_version = 2;
+/// Room for header at start of mapped game file; the playing field follows
+const size_t map_header_room = 4096;
 
-  const int padding = linepadding(m_cols);
+/// Throw runtime_error for failed operation on mapped game file, with errno
+void map_fail(const string &what)
+{
+  throw runtime_error(what + ": " + strerror(errno));
+}
 
-  // Read data block: mine placement & revealed fields
-  for (int r=0; r<m_rows; ++r)
+
+/// Can a field of given size have given topology?
+/** A torus needs at least three rows and columns, or a patch would be its own
+ * neighbour, or the same neighbour twice.
+ */
+bool valid_topology(Topology t, int rows, int cols) throw ()
+{
+  switch (t)
   {
-    for (int c = 0; c < m_cols; c += patchesperchar)
-    {
-      unsigned int x = extract_char(here);
-      for (int i = 0; i < patchesperchar; ++i)
-      {
-	if (x & 2) place_mine_at(r,c+i);
-	if (x & 1) reveal_patch(r,c+i);
-	x >>= 2;
-      }
-    }
-    here = read_eol(here, padding);
+  case square_topology:
+  case hex_topology:
+  case knight_topology:
+    return true;
+  case torus_topology:
+    return rows >= 3 && cols >= 3;
   }
-  read_terminator(here);
+  return false;
 }
 
 
-Lake::~Lake() throw ()
+/// Random-looking key for a patch being mined or revealed (see digest())
+/** The fingerprint is the exclusive-or of the keys for all mined and revealed
+ * patches, so it can be updated in constant time as patches change.  The index
+ * is the one the patch has in row_major_layout, so that a game's fingerprint
+ * does not depend on its layout.
+ */
+inline uint64_t patch_key(int index, bool revealed) throw ()
 {
-  delete [] m_patches;
+  uint64_t x = 2*uint64_t(index) + revealed;
+  return splitmix64(x);
 }
 
 
-void Lake::init_field()
+/// Patch at given position in playing field
+template<typename GRID>
+inline Patch &cell(const GRID &grid, Patch field[], int row, int col)
 {
-  assert(m_rows > 0);
-  assert(m_cols > 0);
-  assert(m_moves >= 0);
-  assert(m_intelligence >= 0);
-
-  m_patches = new Patch[arraysize()];
-  for (int b=1; b<border; ++b)
-  {
-    border_row(-b);
-    border_row(m_rows+b-1);
-    border_col(-b);
-    border_col(m_cols+b-1);
-  }
+  assert(row >= -BasicLake::border);
+  assert(row < grid.rows()+BasicLake::border);
+  assert(col >= -BasicLake::border);
+  assert(col < grid.cols()+BasicLake::border);
+  return field[grid.index_for(row,col)];
 }
 
-int Lake::savesize() const throw ()
+
+/// Is position within the array, border included?
+template<typename GRID> inline bool in_array(const GRID &grid, int row, int col)
 {
-  return m_rows * ((m_cols+patchesperchar-1)/patchesperchar+3) + 100;
+  const int border = BasicLake::border;
+  return row >= -border && row < grid.rows()+border &&
+	col >= -border && col < grid.cols()+border;
 }
 
 
-int Lake::save(char buf[]) const
+/// Apply functor f to a square of Patches centered at (row,col)
+/** The INCLUDECENTER template argument determines whether the central patch
+ * should be included in this square, or whether it should be skipped.
+ *
+ * Zones that lie entirely within the array, which is nearly all of them, are
+ * visited at offsets from the centre that the grid works out without
+ * branching, so the compiler can unroll the loops.  Only zones sticking out of
+ * the border need to be clipped.
+ */
+template<int RADIUS, bool INCLUDECENTER, typename GRID, typename FUNCT>
+inline void for_zone(const GRID &grid, Patch field[], int row, int col, FUNCT f)
 {
-  initialize_encoding();
-  char *here = write_header(buf);
-  here = write_int("rows",here,m_rows);
-  here = write_int("cols",here,m_cols);
-  here = write_int("move",here,m_moves);
-  here = write_int("intl",here,m_intelligence);
-  here = write_newline(here);
+  const int border = BasicLake::border;
 
-  // Padding at end of line required by base64
-  const int padding = linepadding(m_cols);
+  if (row-RADIUS >= -border && row+RADIUS < grid.rows()+border &&
+      col-RADIUS >= -border && col+RADIUS < grid.cols()+border)
+  {
+    Patch *const centre = field + grid.index_for(row,col);
+    for (int dr = -RADIUS; dr <= RADIUS; ++dr)
+      for (int dc = -RADIUS; dc <= RADIUS; ++dc)
+        if (INCLUDECENTER || dr || dc)
+          f(Coords(row+dr,col+dc), centre[grid.offset(row,col,dr,dc)]);
+    return;
+  }
 
-  // Write mines & revealed fields
-  for (int r = 0; r < m_rows; ++r)
+  const int top = max(-border, row-RADIUS),
+	    bottom = min(row+RADIUS+1, grid.rows()+border),
+	    left = max(-border, col-RADIUS),
+	    right = min(col+RADIUS+1, grid.cols()+border);
+
+  for (int r = top; r < bottom; ++r) for (int c = left; c < right; ++c)
+    if (INCLUDECENTER || r!=row || c!=col)
+      f(Coords(r,c),cell(grid,field,r,c));
+}
+
+
+/// Apply functor f to Patches at given offsets from (row,col)
+/** Like for_zone(), this uses fixed offsets into the array wherever the
+ * neighbourhood lies entirely within it, and clips only near its edges.
+ */
+template<int N, int RADIUS, typename GRID, typename FUNCT>
+inline void for_offsets(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	const int (&offsets)[N][2],
+	FUNCT f)
+{
+  if (in_array(grid,row-RADIUS,col-RADIUS) &&
+      in_array(grid,row+RADIUS,col+RADIUS))
   {
-    for (int c = 0; c < m_cols; c += patchesperchar)
+    Patch *const centre = field + grid.index_for(row,col);
+    for (int i = 0; i < N; ++i)
     {
-      unsigned int x = 0;
-      for (int i = patchesperchar-1; i >= 0; --i)
-      {
-	x <<= 2;
-	if (c+i < m_cols && at(r,c+i).mined()) x |= 2;
-	if (c+i < m_cols && at(r,c+i).revealed()) x |= 1;
-      }
-      *here++ = produce_char(x);
+      const int dr = offsets[i][0], dc = offsets[i][1];
+      f(Coords(row+dr,col+dc), centre[grid.offset(row,col,dr,dc)]);
     }
-    here = write_eol(here, padding);
+    return;
   }
-  terminate(here);
 
-  return here - buf;
+  for (int i = 0; i < N; ++i)
+  {
+    const int r = row+offsets[i][0], c = col+offsets[i][1];
+    if (in_array(grid,r,c)) f(Coords(r,c),cell(grid,field,r,c));
+  }
 }
 
 
-bool Lake::place_mine_at(int row, int col)
+/// Functor: apply f to a patch, and to its neighbours
+template<typename TOPOLOGY, typename GRID, typename FUNCT> class visit_vicinity
 {
-  Patch &p = at(row,col);
-  if (p.mined()) return false;
+public:
+  visit_vicinity(const GRID &grid, Patch field[], FUNCT f) :
+    m_grid(grid), m_field(field), m_f(f) {}
+  void operator()(Coords c, Patch &) const
+	{ TOPOLOGY::for_vicinity(m_grid,m_field,c.row,c.col,m_f); }
+private:
+  const GRID &m_grid;
+  Patch *m_field;
+  FUNCT m_f;
+};
 
-  p.mine();
-  --m_patches_to_go;
-  for_neighbours(row,col,set_nearby_mine());
-  return true;
-}
 
-const Patch &Lake::at(int row, int col) const
+/// Common parts of topology policies; TOPOLOGY is the derived policy itself
+/** A topology policy defines which patches are each other's neighbours.  Each
+ * policy provides:
+ *
+ * - neighbours, the number of neighbours each patch in the field has;
+ * - reach, how many rows or columns away a neighbour may be;
+ * - margin, how far outside the field the numbers shown to the player go;
+ * - for_neighbours(), to apply a functor to each of a patch's neighbours.
+ *
+ * From those, this template derives for_vicinity(), which also includes the
+ * patch itself, and for_area(), which covers everything within two steps.
+ */
+template<typename TOPOLOGY> struct BasicTopology
 {
-  check_pos(row, col);
-  const int idx = index_for(row, col);
-  check_index(idx);
-  return m_patches[idx];
-}
+  template<typename GRID, typename FUNCT>
+  static void for_vicinity(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	FUNCT f)
+  {
+    f(Coords(row,col), cell(grid,field,row,col));
+    TOPOLOGY::for_neighbours(grid,field,row,col,f);
+  }
+
+  template<typename GRID, typename FUNCT>
+  static void for_area(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	FUNCT f)
+  {
+    f(Coords(row,col), cell(grid,field,row,col));
+    TOPOLOGY::for_neighbours(grid,field,row,col,
+	visit_vicinity<TOPOLOGY,GRID,FUNCT>(grid,field,f));
+  }
+};
 
 
-Patch &Lake::at(int row, int col)
+/// Classic square neighbourhood; see BasicTopology
+struct SquareTopology : BasicTopology<SquareTopology>
 {
-  check_pos(row, col);
-  const int idx = index_for(row, col);
-  check_index(idx);
-  return m_patches[idx];
-}
+  enum { neighbours = 8, reach = 1, margin = 1 };
+
+  template<typename GRID, typename FUNCT>
+  static void for_neighbours(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	FUNCT f)
+  {
+    for_zone<1,false>(grid,field,row,col,f);
+  }
 
-void Lake::probe(int row, int col, set<Coords> &changes, bool as_mine)
+  // The square "vicinity" and "area" are simply larger squares
+  template<typename GRID, typename FUNCT>
+  static void for_vicinity(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	FUNCT f)
+  {
+    for_zone<1,true>(grid,field,row,col,f);
+  }
+
+  template<typename GRID, typename FUNCT>
+  static void for_area(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	FUNCT f)
+  {
+    for_zone<2,true>(grid,field,row,col,f);
+  }
+};
+
+
+/// Hexagonal patches, with odd rows shifted right; see BasicTopology
+struct HexTopology : BasicTopology<HexTopology>
 {
-  assert(m_patches_to_go >= 0);
+  enum { neighbours = 6, reach = 1, margin = 1 };
+
+  template<typename GRID, typename FUNCT>
+  static void for_neighbours(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	FUNCT f)
+  {
+    static const int even[neighbours][2] =
+	{ {-1,-1}, {-1,0}, {0,-1}, {0,1}, {1,-1}, {1,0} };
+    static const int odd[neighbours][2] =
+	{ {-1,0}, {-1,1}, {0,-1}, {0,1}, {1,0}, {1,1} };
+    for_offsets<neighbours,reach>(grid,field,row,col,(row&1)?odd:even,f);
+  }
+};
 
-  Patch &p = at(row,col);
-  if (!p.revealed())
+
+/// Square patches on a field whose edges wrap around; see BasicTopology
+/** The border is still there, but patches in it have no neighbours at all, and
+ * neither are they anyone's neighbour.  It's never shown to the player.
+ */
+struct TorusTopology : BasicTopology<TorusTopology>
+{
+  enum { neighbours = 8, reach = 1, margin = 0 };
+
+  template<typename GRID, typename FUNCT>
+  static void for_neighbours(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	FUNCT f)
   {
-    ++m_moves;
-    const Coords pos(row,col);
-    if (p.mined() != as_mine)
+    const int rows = grid.rows(), cols = grid.cols();
+    if (row < 0 || row >= rows || col < 0 || col >= cols) return;
+
+    if (row > 0 && row < rows-1 && col > 0 && col < cols-1)
     {
-      reveal_patch(row,col);
-      throw Boom(pos, m_moves, p.mined());
+      for_zone<1,false>(grid,field,row,col,f);
+      return;
+    }
+
+    for (int dr = -1; dr <= 1; ++dr) for (int dc = -1; dc <= 1; ++dc)
+    {
+      if (!dr && !dc) continue;
+      const int r = (row+dr+rows) % rows, c = (col+dc+cols) % cols;
+      f(Coords(r,c), cell(grid,field,r,c));
     }
-    set<Coords> worklist;
-    worklist.insert(pos);
-    propagate(worklist, changes);
-    assert(m_patches_to_go >= 0);
   }
-}
+};
 
-char Lake::status_at(int row, int col) const
-{
-  const Patch &p = at(row,col);
-  return p.revealed() ? (p.mined() ? '*' : ('0'+p.near_mines())) : '^';
-}
 
-void Lake::reveal_patch(int row, int col)
+/// Neighbours are a chess knight's move away; see BasicTopology
+struct KnightTopology : BasicTopology<KnightTopology>
 {
-  Patch &p = at(row,col);
-  if (!p.revealed())
+  enum { neighbours = 8, reach = 2, margin = 1 };
+
+  template<typename GRID, typename FUNCT>
+  static void for_neighbours(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	FUNCT f)
   {
-    p.reveal();
-    for_neighbours(row,col,reveal_nearby(p.mined()));
-    if (row >= 0 && row < m_rows && col >= 0 && col < m_cols && !p.mined())
-      --m_patches_to_go;
+    static const int jumps[neighbours][2] =
+    {
+      {-2,-1}, {-2,1}, {-1,-2}, {-1,2}, {1,-2}, {1,2}, {2,-1}, {2,1}
+    };
+    for_offsets<neighbours,reach>(grid,field,row,col,jumps,f);
   }
-}
+};
 
-void Lake::border_row(int r)
-{
-  for (int c=m_cols+border-1; c>=-border; --c) reveal_patch(r,c);
-}
 
-void Lake::border_col(int c)
+/// Grid whose dimensions are only known at runtime
+template<typename TOPOLOGY> class DynamicGrid
 {
-  for (int r=m_rows-1; r>=0; --r) reveal_patch(r,c);
-}
+public:
+  typedef TOPOLOGY topology;
+
+  DynamicGrid(int rows, int cols) : m_rows(rows), m_cols(cols) {}
+
+  int rows() const throw () { return m_rows; }
+  int cols() const throw () { return m_cols; }
+  int stride() const throw () { return m_cols + 2*BasicLake::border; }
+  int index_for(int row, int col) const throw ()
+	{ return (row+BasicLake::border)*stride() + col + BasicLake::border; }
+  /// Where patch at (row+dr, col+dc) is, relative to the one at (row, col)
+  int offset(int, int, int dr, int dc) const throw ()
+	{ return dr*stride() + dc; }
+  /// Index that the patch would have in row_major_layout; see patch_key()
+  int row_major(int row, int col) const throw ()
+	{ return index_for(row,col); }
+
+private:
+  int m_rows, m_cols;
+};
 
-void Lake::propagate(set<Coords> &work, set<Coords> &changes)
+typedef DynamicGrid<SquareTopology> SquareGrid;
+typedef DynamicGrid<HexTopology> HexGrid;
+typedef DynamicGrid<TorusTopology> TorusGrid;
+typedef DynamicGrid<KnightTopology> KnightGrid;
+
+
+/// Square grid in blocked_layout: blocks of 8 by 8 patches, row by row
+/** Within a block, too, patches go row by row.  Finding a patch takes a few
+ * shifts and masks, but no branches, so it's as quick to find a neighbour in
+ * the next block as one in the same block.
+ */
+class BlockedGrid
 {
-  while (!work.empty())
+public:
+  typedef SquareTopology topology;
+
+  BlockedGrid(int rows, int cols) :
+    m_rows(rows), m_cols(cols),
+    m_blocks((cols + 2*BasicLake::border + 7) / 8)
   {
-    set<Coords> next, area;
+  }
 
-    /* Reveal any patches from working set with no nearby mines, and their
-     * neighbours.  This part is what all Minesweeper implementations do.
-     */
-    for (set<Coords>::const_iterator i = work.begin(); i != work.end(); ++i)
-    {
-      const int row = i->row, col = i->col;
-      if (row >= 0 && row < m_rows && col >= 0 && col < m_cols)
-      {
-        Patch &p = at(row,col);
-        if (!p.revealed())
-        {
-          reveal_patch(row,col);
-	  changes.insert(Coords(row,col));
-          for_zone<2,true>(row,col,set_add<UnfinishedPatch>(area));
-        }
-        if (m_intelligence > 0 && p.obvious())
-          for_neighbours(row,col,set_add<UnrevealedPatch>(next));
-      }
-    }
+  int rows() const throw () { return m_rows; }
+  int cols() const throw () { return m_cols; }
+  int index_for(int row, int col) const throw ()
+  {
+    const int r = row + BasicLake::border, c = col + BasicLake::border;
+    return (((r >> 3)*m_blocks + (c >> 3)) << 6) | ((r & 7) << 3) | (c & 7);
+  }
+  int offset(int row, int col, int dr, int dc) const throw ()
+	{ return index_for(row+dr,col+dc) - index_for(row,col); }
+  int row_major(int row, int col) const throw ()
+  {
+    return (row+BasicLake::border)*(m_cols + 2*BasicLake::border) +
+	col + BasicLake::border;
+  }
 
-    /* Recognize revealed Patches whose unexplored neighbours must obviously be
-     * either all clear or all mines, and reveal their neighbours.
-     */
-    if (m_intelligence > 1)
-      for (set<Coords>::const_iterator i = area.begin(); i != area.end(); ++i)
-        for_zone<1,true>(i->row,i->col,set_add<ObviousPatch>(next));
+private:
+  int m_rows, m_cols;
+  /// Number of blocks across each row of blocks
+  int m_blocks;
+};
 
-    /* Recognize cases where two patches' sets of nearby unrevealed patches
-     * overlap, such that one of the two difference sets can be concluded to be
-     * mine-free and the other have only mined patches.  One of the two
-     * difference sets may be empty.
-     */
-    if (m_intelligence > 2)
-    {
-      // TODO: TODO: TODO:
-    }
 
-    work.swap(next);
-  }
-}
+/// Grid whose dimensions are known at compile time
+template<int ROWS, int COLS> class FixedGrid
+{
+public:
+  typedef SquareTopology topology;
+
+  int rows() const throw () { return ROWS; }
+  int cols() const throw () { return COLS; }
+  int stride() const throw () { return COLS + 2*BasicLake::border; }
+  int index_for(int row, int col) const throw ()
+	{ return (row+BasicLake::border)*stride() + col + BasicLake::border; }
+  int offset(int, int, int dr, int dc) const throw ()
+	{ return dr*stride() + dc; }
+  int row_major(int row, int col) const throw ()
+	{ return index_for(row,col); }
+};
 
 
-int Lake::index_for(int row, int col) const throw ()
+template<typename GRID, typename FUNCT>
+inline void for_neighbours(const GRID &grid,
+	Patch field[],
+	int row,
+	int col,
+	FUNCT f)
 {
-  return (row+border)*(m_cols+2*border) + col + border;
+  GRID::topology::for_neighbours(grid,field,row,col,f);
 }
 
 
-int Lake::arraysize() const throw ()
+/// Functor: list positions of the patches it's applied to
+class list_coords
 {
-  return (m_rows+2*border)*(m_cols+2*border);
-}
+public:
+  list_coords(int rows[], int cols[], int &count) :
+    m_rows(rows), m_cols(cols), m_count(count) {}
+  void operator()(Coords pos, Patch &) const
+  {
+    m_rows[m_count] = pos.row;
+    m_cols[m_count] = pos.col;
+    ++m_count;
+  }
+private:
+  int *m_rows, *m_cols;
+  int &m_count;
+};
 
 
-void Lake::check_index(int i) const
+/// Find representative of a set in union-find structure, halving its path
+int find_root(vector<int> &parent, int i) throw ()
 {
-  assert(i >= 0);
-  assert(i < arraysize());
+  while (parent[i] != i)
+  {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
 }
 
 
-void Lake::check_pos(int row, int col) const
+/// List the different openings that patch borders on; returns how many
+/** The labels are as set by BasicLake::label_openings().
+ */
+template<typename GRID> int openings_near(const GRID &grid,
+	Patch field[],
+	const vector<int> &labels,
+	int row,
+	int col,
+	int found[])
 {
-  assert(row >= -border);
-  assert(row < m_rows+border);
+  enum { neighbours = GRID::topology::neighbours };
+  int nrows[neighbours], ncols[neighbours], count = 0, n = 0;
+  for_neighbours(grid, field, row, col, list_coords(nrows, ncols, count));
+  for (int i = 0; i < count; ++i)
+  {
+    if (nrows[i] < 0 || nrows[i] >= grid.rows() ||
+	ncols[i] < 0 || ncols[i] >= grid.cols())
+      continue;
+    const int o = labels[nrows[i]*grid.cols() + ncols[i]];
+    if (o >= 0 && find(found, found+n, o) == found+n) found[n++] = o;
+  }
+  return n;
+}
+
+} // namespace
+
+
+/// Openings of a playing field, labelled in advance; see index_openings()
+struct OpeningIndex
+{
+  /// Run of consecutive patches, numbered row by row as row*cols + col
+  struct Span
+  {
+    int start, length;
+  };
+
+  OpeningIndex() : valid(false), labels(), first(), spans() {}
+
+  /// Do the labels still match the mines?  Moving a mine upsets them.
+  bool valid;
+  /// For each patch, row by row, the opening it's in; -1 if it's not a zero
+  std::vector<int> labels;
+  /// Where each opening's runs start in spans, plus where the last one ends
+  std::vector<int> first;
+  /// Each opening's patches, plus the numbers along its edge
+  std::vector<Span> spans;
+};
+
+
+/// What init_field() leaves behind, apart from patches it doesn't touch
+struct BlankField
+{
+  BlankField() :
+    rows(0), cols(0), topology(square_topology), layout(row_major_layout),
+    patches(), numbers(), unknowns(), digest(0)
+  {
+  }
+
+  /// Dimensions of the playing field this was made for
+  int rows, cols;
+  Topology topology;
+  Layout layout;
+  /// Patches that are different from a new Patch, by index into m_patches
+  std::vector<std::pair<int, Patch> > patches;
+  /// Frontier index, numbers and unknowns, in order
+  std::vector<int> numbers, unknowns;
+  uint64_t digest;
+};
+
+
+BasicLake::BasicLake(int _rows, int _cols, int intelligence, Topology t) :
+  m_patches(0),
+  m_frontier(0),
+  m_frontier_numbers(0),
+  m_frontier_unknowns(0),
+  m_rows(_rows),
+  m_cols(_cols),
+  m_topology(t),
+  m_layout(row_major_layout),
+  m_intelligence(intelligence),
+  m_patches_to_go(0),
+  m_moves(0),
+  m_random(0),
+  m_digest(0),
+  m_hints(0),
+  m_log(0),
+  m_openings(0),
+  m_blank(0),
+  m_obvious(),
+  m_settled(false)
+{
+}
+
+
+BasicLake::~BasicLake() throw ()
+{
+  drop_hints();
+  delete m_openings;
+  delete m_blank;
+}
+
+
+void BasicLake::swap_state(BasicLake &other) throw ()
+{
+  // A hint cache belongs with the object it was made for
+  drop_hints();
+  other.drop_hints();
+
+  std::swap(m_patches, other.m_patches);
+  std::swap(m_frontier, other.m_frontier);
+  std::swap(m_frontier_numbers, other.m_frontier_numbers);
+  std::swap(m_frontier_unknowns, other.m_frontier_unknowns);
+  std::swap(m_rows, other.m_rows);
+  std::swap(m_cols, other.m_cols);
+  std::swap(m_topology, other.m_topology);
+  std::swap(m_layout, other.m_layout);
+  std::swap(m_intelligence, other.m_intelligence);
+  std::swap(m_patches_to_go, other.m_patches_to_go);
+  std::swap(m_moves, other.m_moves);
+  std::swap(m_random, other.m_random);
+  std::swap(m_digest, other.m_digest);
+  std::swap(m_log, other.m_log);
+  std::swap(m_openings, other.m_openings);
+  std::swap(m_blank, other.m_blank);
+  m_obvious.swap(other.m_obvious);
+  std::swap(m_settled, other.m_settled);
+}
+
+
+void BasicLake::drop_hints() throw ()
+{
+  delete m_hints;
+  m_hints = 0;
+}
+
+
+void BasicLake::update_hints(const set<Coords> &revealed) throw ()
+{
+  if (!m_hints) return;
+  try
+  {
+    m_hints->update(revealed);
+  }
+  catch (const exception &)
+  {
+    // Out of memory or some such; rebuild from scratch when next needed
+    drop_hints();
+  }
+}
+
+
+bool BasicLake::hint(Hint &h)
+{
+  if (m_topology != square_topology)
+    throw logic_error("Hints are only available in square topology");
+  if (!m_hints) m_hints = new HintCache(*this);
+  return m_hints->best(h);
+}
+
+
+template<typename GRID> void BasicLake::clear_field(const GRID &)
+{
+  assert(m_rows > 0);
+  assert(m_cols > 0);
+  assert(m_moves >= 0);
+  assert(m_intelligence >= 0);
+
+  typedef typename GRID::topology topology;
+
+  drop_hints();
+  m_log = 0;
+  if (m_openings) m_openings->valid = false;
+  m_obvious.clear();
+  m_settled = true;
+  uninitialized_fill_n(m_patches, arraysize(), Patch(topology::neighbours));
+}
+
+
+template<typename GRID> void BasicLake::init_field(const GRID &grid)
+{
+  clear_field(grid);
+  if (m_blank && m_blank->rows == m_rows && m_blank->cols == m_cols &&
+      m_blank->topology == m_topology && m_blank->layout == m_layout)
+  {
+    // Same size as the last field we set up; copy its border
+    const BlankField &b = *m_blank;
+    for (size_t i = 0; i < b.patches.size(); ++i)
+      m_patches[b.patches[i].first] = b.patches[i].second;
+    m_frontier_numbers = int(b.numbers.size());
+    m_frontier_unknowns = int(b.unknowns.size());
+    copy(b.numbers.begin(), b.numbers.end(), m_frontier);
+    copy(b.unknowns.begin(),
+	b.unknowns.end(),
+	m_frontier + arraysize() - m_frontier_unknowns);
+    m_digest = b.digest;
+    return;
+  }
+
+  m_frontier_numbers = 0;
+  m_frontier_unknowns = 0;
+  m_digest = 0;
+  reveal_border(grid, false);
+  if (m_blank) remember_blank(grid);
+}
+
+
+template<typename GRID>
+void BasicLake::reveal_border(const GRID &grid, bool quietly)
+{
+  /* Reveal the border, far enough out that the numbers just outside the field
+   * have no unexplored neighbours outside it.  That's everything but the
+   * outermost ring, unless neighbours can be further than one step away.
+   */
+  for (int b=1; b<=GRID::topology::reach+1 && b<=border; ++b)
+  {
+    for (int c=m_cols+border-1; c>=-border; --c)
+    {
+      if (quietly)
+      {
+	cell(grid,m_patches,-b,c).reveal();
+	cell(grid,m_patches,m_rows+b-1,c).reveal();
+      }
+      else
+      {
+	reveal_patch(grid,-b,c);
+	reveal_patch(grid,m_rows+b-1,c);
+      }
+    }
+    for (int r=m_rows-1; r>=0; --r)
+    {
+      if (quietly)
+      {
+	cell(grid,m_patches,r,-b).reveal();
+	cell(grid,m_patches,r,m_cols+b-1).reveal();
+      }
+      else
+      {
+	reveal_patch(grid,r,-b);
+	reveal_patch(grid,r,m_cols+b-1);
+      }
+    }
+  }
+}
+
+
+template<typename GRID> void BasicLake::remember_blank(const GRID &) throw ()
+{
+  const Patch fresh(GRID::topology::neighbours);
+  try
+  {
+    BlankField &b = *m_blank;
+    b.rows = b.cols = 0;
+    b.patches.clear();
+    for (int i = 0; i < arraysize(); ++i)
+    {
+      const Patch &p = m_patches[i];
+      if (p.revealed() != fresh.revealed() ||
+	  p.near_unknown() != fresh.near_unknown() ||
+	  p.slot() != fresh.slot())
+	b.patches.push_back(make_pair(i, p));
+    }
+    b.numbers.assign(m_frontier, m_frontier + m_frontier_numbers);
+    b.unknowns.assign(m_frontier + arraysize() - m_frontier_unknowns,
+	m_frontier + arraysize());
+    b.digest = m_digest;
+    b.topology = m_topology;
+    b.layout = m_layout;
+    b.rows = m_rows;
+    b.cols = m_cols;
+  }
+  catch (const exception &)
+  {
+    // Out of memory; just do it the slow way next time
+    delete m_blank;
+    m_blank = 0;
+  }
+}
+
+
+template<typename GRID>
+void BasicLake::new_game(const GRID &grid, int mines, unsigned long seed)
+{
+  m_patches_to_go = m_rows*m_cols;
+  m_moves = 0;
+  m_random = seed;
+
+  init_field(grid);
+  place_mines(grid, mines);
+  if (m_openings) build_openings(grid);
+}
+
+
+const char *BasicLake::read_state_header(const char buffer[], bool &sparse)
+{
+  SaveFormat format;
+  const char *here = read_header(buffer, format);
+  sparse = (format == sparse_format);
+
+  m_rows = read_int("rows",here);
+  m_cols = read_int("cols",here);
+  m_moves = read_int("move",here);
+  m_intelligence = read_int("intl",here);
+  m_topology = Topology(read_optional_int("topo",here,square_topology));
+  if (!valid_topology(m_topology, m_rows, m_cols))
+    throw runtime_error("Saved game has invalid topology");
+
+  return skip_whitespace(here);
+}
+
+
+template<typename GRID>
+void BasicLake::load_field(const GRID &grid, const char *here, bool sparse)
+{
+  m_patches_to_go = m_rows * m_cols;
+
+  /* Placing mines and revealing patches one by one would update the counters
+   * in their neighbourhoods, and the frontier index, many times over.  Mark
+   * them all first, border included, then count them up in a single pass.
+   */
+  clear_field(grid);
+  m_frontier_numbers = 0;
+  m_frontier_unknowns = 0;
+  m_digest = 0;
+  reveal_border(grid, true);
+  here = sparse ? read_sparse(grid, here) : read_dense(grid, here);
+  read_terminator(here);
+  count_loaded(grid);
+  build_frontier(grid);
+  if (m_openings) build_openings(grid);
+  check_settled();
+}
+
+
+template<typename GRID>
+const char *BasicLake::read_dense(const GRID &grid, const char *here)
+{
+  const int padding = linepadding(m_cols);
+
+  // Read data block: mine placement & revealed fields
+  for (int r=0; r<m_rows; ++r)
+  {
+    for (int c = 0; c < m_cols; c += patchesperchar)
+    {
+      unsigned int x = extract_char(here);
+      for (int i = 0; i < patchesperchar && c+i < m_cols; ++i)
+      {
+	Patch &p = cell(grid,m_patches,r,c+i);
+	if (x & 2) p.mine();
+	if (x & 1) p.reveal();
+	x >>= 2;
+      }
+    }
+    here = read_eol(here, padding);
+  }
+  return here;
+}
+
+
+template<typename GRID>
+const char *BasicLake::read_sparse(const GRID &grid, const char *here)
+{
+  const unsigned long cells = static_cast<unsigned long>(m_rows) * m_cols;
+
+  // Mines, as gaps between them.  All mines go in before anything is revealed.
+  unsigned long pos = 0;
+  for (int mines = read_int("mine",here); mines > 0; --mines, ++pos)
+  {
+    pos += read_varint(here);
+    if (pos >= cells)
+      throw runtime_error("Saved game format error: mine outside field");
+    cell(grid, m_patches, int(pos / m_cols), int(pos % m_cols)).mine();
+  }
+
+  // Runs of revealed patches, as gap before the run and length minus one
+  pos = 0;
+  for (int runs = read_int("runs",here); runs > 0; --runs)
+  {
+    pos += read_varint(here);
+    const unsigned long end = pos + read_varint(here) + 1;
+    if (end > cells)
+      throw runtime_error("Saved game format error: run outside field");
+    int r = int(pos / m_cols), c = int(pos % m_cols);
+    for (; pos < end; ++pos)
+    {
+      cell(grid, m_patches, r, c).reveal();
+      if (++c == m_cols)
+      {
+	c = 0;
+	++r;
+      }
+    }
+  }
+  return here;
+}
+
+
+/// Functor: update a neighbour's place on the frontier
+/** Applied to the neighbours of a patch that has just been revealed, or that
+ * has just been added to the frontier as a visible number.
+ */
+class BasicLake::frontier_neighbour
+{
+public:
+  /// Is the patch whose neighbours we're visiting a visible number?
+  frontier_neighbour(BasicLake &lake, bool number) :
+    m_lake(lake), m_number(number) {}
+  void operator()(Coords c, Patch &q) const
+  {
+    const int n = int(&q - m_lake.m_patches);
+    if (q.revealed())
+    {
+      if (q.slot() >= 0 && !q.near_unknown()) m_lake.remove_frontier_number(n);
+    }
+    else if (m_number && q.slot() < 0 &&
+	     c.row >= 0 && c.row < m_lake.m_rows &&
+	     c.col >= 0 && c.col < m_lake.m_cols)
+    {
+      m_lake.add_frontier_unknown(n);
+    }
+  }
+
+private:
+  BasicLake &m_lake;
+  bool m_number;
+};
+
+
+/// Functor: note that nearby patch has been revealed, update counters
+/** Patches in the field that become obvious as a result are listed in
+ * m_obvious, and the frontier is updated along the way, so that revealing a
+ * patch takes only a single pass over its neighbours.
+ */
+class BasicLake::reveal_nearby
+{
+public:
+  reveal_nearby(BasicLake &lake, bool mined, bool number) :
+    m_lake(lake), m_mine(mined), m_frontier(lake, number) {}
+  void operator()(Coords c, Patch &q) const
+  {
+    if (q.reveal_nearby(m_mine) &&
+	c.row >= 0 && c.row < m_lake.m_rows &&
+	c.col >= 0 && c.col < m_lake.m_cols)
+      m_lake.m_obvious.push_back(c);
+    m_frontier(c,q);
+  }
+
+private:
+  BasicLake &m_lake;
+  bool m_mine;
+  frontier_neighbour m_frontier;
+};
+
+
+template<typename GRID> void BasicLake::count_loaded(const GRID &grid)
+{
+  for (int r = -border; r < m_rows+border; ++r)
+    for (int c = -border; c < m_cols+border; ++c)
+    {
+      const Patch &p = cell(grid,m_patches,r,c);
+      const bool mined = p.mined(), revealed = p.revealed();
+      if (!mined && !revealed) continue;
+
+      const int index = grid.row_major(r,c);
+      if (mined) m_digest ^= patch_key(index, false);
+      if (revealed) m_digest ^= patch_key(index, true);
+      if (r >= 0 && r < m_rows && c >= 0 && c < m_cols) --m_patches_to_go;
+      for_neighbours(grid,m_patches,r,c,load_nearby(mined, revealed));
+    }
+}
+
+
+template<typename GRID> void BasicLake::build_frontier(const GRID &grid)
+{
+  assert(!m_frontier_numbers);
+  assert(!m_frontier_unknowns);
+
+  // Visible numbers with unexplored neighbours, and those neighbours
+  const int margin = GRID::topology::margin;
+  for (int r = -margin; r < m_rows+margin; ++r)
+    for (int c = -margin; c < m_cols+margin; ++c)
+    {
+      const int idx = grid.index_for(r,c);
+      const Patch &p = m_patches[idx];
+      if (!p.revealed() || p.mined() || !p.near_unknown()) continue;
+      add_frontier_number(idx);
+      for_neighbours(grid,m_patches,r,c,frontier_neighbour(*this,true));
+    }
+}
+
+
+/// Functor: place mine at given position, unless there already is one
+template<typename GRID> class BasicLake::place_mine
+{
+public:
+  place_mine(BasicLake &lake, const GRID &grid) : m_lake(lake), m_grid(grid) {}
+  bool operator()(int row, int col) const
+	{ return m_lake.place_mine_at(m_grid,row,col); }
+
+private:
+  BasicLake &m_lake;
+  const GRID &m_grid;
+};
+
+
+template<typename GRID> void BasicLake::place_mines(const GRID &grid, int mines)
+{
+  m_random = scatter_mines(m_random, m_rows, m_cols, mines,
+	place_mine<GRID>(*this,grid));
+}
+
+
+unsigned long BasicLake::rand_seed()
+{
+  // rand() may give us as few as 15 bits at a time
+  unsigned long seed = 0;
+  for (int i = 0; i < 5; ++i) seed = (seed << 15) ^ rand();
+  return seed;
+}
+
+
+template<typename FUNCT> void BasicLake::sparse_mines(FUNCT &f) const
+{
+  unsigned long pos = 0, next = 0;
+  for (int r = 0; r < m_rows; ++r)
+  {
+    for (int c = 0; c < m_cols; ++c, ++pos)
+      if (m_patches[index_for(r,c)].mined())
+      {
+	f(pos - next);
+	next = pos + 1;
+      }
+  }
+}
+
+
+template<typename FUNCT> void BasicLake::sparse_reveals(FUNCT &f) const
+{
+  unsigned long pos = 0, next = 0;
+  bool inside = false;
+  for (int r = 0; r < m_rows; ++r)
+  {
+    for (int c = 0; c < m_cols; ++c, ++pos)
+      if (m_patches[index_for(r,c)].revealed() != inside)
+      {
+	// Gap since end of previous run, or length of run that ends here
+	f(pos - next - inside);
+	next = pos;
+	inside = !inside;
+      }
+  }
+  if (inside) f(pos - next - 1);
+}
+
+
+int BasicLake::savesize() const throw ()
+{
+  varint_counter mines, reveals;
+  sparse_mines(mines);
+  sparse_reveals(reveals);
+  return min(dense_size(m_rows,m_cols), sparse_size(mines,reveals));
+}
+
+
+int BasicLake::save(char buf[]) const
+{
+  varint_counter mines, reveals;
+  sparse_mines(mines);
+  sparse_reveals(reveals);
+  const bool sparse =
+	sparse_size(mines,reveals) < dense_size(m_rows,m_cols);
+
+  char *here = write_header(buf, sparse ? sparse_format : dense_format);
+  here = write_int("rows",here,m_rows);
+  here = write_int("cols",here,m_cols);
+  here = write_int("move",here,m_moves);
+  here = write_int("intl",here,m_intelligence);
+  if (m_topology != square_topology) here = write_int("topo",here,m_topology);
+  here = write_newline(here);
+
+  if (sparse)
+  {
+    varint_writer out(here);
+    here = write_int("mine",here,mines.values());
+    sparse_mines(out);
+    here = write_newline(here);
+    here = write_int("runs",here,reveals.values()/2);
+    sparse_reveals(out);
+    here = write_newline(here);
+    terminate(here);
+    return here - buf;
+  }
+
+  // Padding at end of line required by base64
+  const int padding = linepadding(m_cols);
+
+  // Write mines & revealed fields
+  for (int r = 0; r < m_rows; ++r)
+  {
+    for (int c = 0; c < m_cols; c += patchesperchar)
+    {
+      unsigned int x = 0;
+      for (int i = patchesperchar-1; i >= 0; --i)
+      {
+	x <<= 2;
+	if (c+i >= m_cols) continue;
+	const Patch &p = m_patches[index_for(r,c+i)];
+	if (p.mined()) x |= 2;
+	if (p.revealed()) x |= 1;
+      }
+      *here++ = produce_char(x);
+    }
+    here = write_eol(here, padding);
+  }
+  terminate(here);
+
+  return here - buf;
+}
+
+
+template<typename GRID>
+bool BasicLake::place_mine_at(const GRID &grid, int row, int col)
+{
+  Patch &p = cell(grid,m_patches,row,col);
+  if (p.mined()) return false;
+
+  p.mine();
+  m_digest ^= patch_key(grid.row_major(row,col), false);
+  --m_patches_to_go;
+  for_neighbours(grid,m_patches,row,col,set_nearby_mine());
+  return true;
+}
+
+
+template<typename GRID>
+void BasicLake::move_mine(const GRID &grid, Coords from, Coords to)
+{
+  Patch &f = cell(grid,m_patches,from.row,from.col),
+	&t = cell(grid,m_patches,to.row,to.col);
+  assert(!t.revealed());
+
+  drop_hints();
+  if (m_openings) m_openings->valid = false;
+  f.unmine();
+  for_neighbours(grid,m_patches,from.row,from.col,unset_nearby_mine());
+  t.mine();
+  m_digest ^= patch_key(grid.row_major(from.row,from.col), false) ^
+	patch_key(grid.row_major(to.row,to.col), false);
+  for_neighbours(grid,m_patches,to.row,to.col,set_nearby_mine());
+
+  // Numbers around both patches may have become obvious
+  set<Coords> obvious;
+  for_neighbours(grid,m_patches,from.row,from.col,
+	set_add<ObviousPatch>(obvious));
+  for_neighbours(grid,m_patches,to.row,to.col,set_add<ObviousPatch>(obvious));
+  for (set<Coords>::const_iterator i = obvious.begin(); i != obvious.end(); ++i)
+    if (i->row >= 0 && i->row < m_rows && i->col >= 0 && i->col < m_cols)
+      note_obvious(*i);
+}
+
+
+const Patch &BasicLake::at(int row, int col) const
+{
+  check_pos(row, col);
+  const int idx = index_for(row, col);
+  check_index(idx);
+  return m_patches[idx];
+}
+
+
+Patch &BasicLake::at(int row, int col)
+{
+  check_pos(row, col);
+  const int idx = index_for(row, col);
+  check_index(idx);
+  return m_patches[idx];
+}
+
+
+template<typename GRID> void BasicLake::probe(const GRID &grid,
+	int row,
+	int col,
+	set<Coords> &changes,
+	bool as_mine)
+{
+  assert(m_patches_to_go >= 0);
+
+  Patch &p = cell(grid,m_patches,row,col);
+  if (!p.revealed())
+  {
+    ++m_moves;
+    const Coords pos(row,col);
+    if (p.mined() != as_mine)
+    {
+      reveal_patch(grid,row,col);
+      // Nothing will look at what the explosion made obvious
+      if (!m_obvious.empty())
+      {
+	m_obvious.clear();
+	m_settled = false;
+      }
+      if (m_hints) update_hints(set<Coords>(&pos, &pos+1));
+      if (m_log) m_log->record(*this, pos, as_mine, -1);
+      throw Boom(pos, m_moves, p.mined());
+    }
+    set<Coords> worklist;
+    if (m_hints)
+    {
+      // The caller's changes may not start out empty; keep ours separate
+      set<Coords> revealed;
+      if (!reveal_opening(grid, row, col, worklist, revealed))
+	worklist.insert(pos);
+      propagate(grid, worklist, revealed);
+      update_hints(revealed);
+      changes.insert(revealed.begin(), revealed.end());
+    }
+    else
+    {
+      if (!reveal_opening(grid, row, col, worklist, changes))
+	worklist.insert(pos);
+      propagate(grid, worklist, changes);
+    }
+    assert(m_patches_to_go >= 0);
+    if (m_log) m_log->record(*this, pos, as_mine, m_patches_to_go);
+  }
+}
+
+void BasicLake::record(MoveLog *log)
+{
+  if (log) log->start(*this);
+  m_log = log;
+}
+
+
+uint64_t BasicLake::digest() const throw ()
+{
+  uint64_t moves = m_moves;
+  return m_digest ^ splitmix64(moves);
+}
+
+
+char BasicLake::status_at(int row, int col) const
+{
+  const Patch &p = at(row,col);
+  return p.revealed() ? (p.mined() ? '*' : ('0'+p.near_mines())) : '^';
+}
+
+
+void BasicLake::metrics(BoardMetrics &m) const
+{
+  switch (m_topology)
+  {
+  case square_topology:
+    if (m_layout == blocked_layout) measure(BlockedGrid(m_rows,m_cols), m);
+    else measure(SquareGrid(m_rows,m_cols), m);
+    break;
+  case hex_topology:
+    measure(HexGrid(m_rows,m_cols), m);
+    break;
+  case torus_topology:
+    measure(TorusGrid(m_rows,m_cols), m);
+    break;
+  case knight_topology:
+    measure(KnightGrid(m_rows,m_cols), m);
+    break;
+  }
+}
+
+
+template<typename GRID>
+int BasicLake::label_openings(const GRID &grid, vector<int> &labels) const
+{
+  enum { neighbours = GRID::topology::neighbours };
+  int nrows[neighbours], ncols[neighbours];
+
+  /* Union-find structure over the patches in the field, numbered row by row.
+   * Patches that are not zeroes (clear, with no mines around them) are -1.
+   * Each set's representative is its lowest-numbered patch, so every patch's
+   * parent comes before it.
+   */
+  vector<int> &parent = labels;
+  parent.assign(m_rows*m_cols, -1);
+  for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+  {
+    const Patch &p = m_patches[grid.index_for(r,c)];
+    if (p.mined() || p.near_mines()) continue;
+
+    const int i = r*m_cols + c;
+    parent[i] = i;
+    int count = 0;
+    for_neighbours(grid, m_patches, r, c, list_coords(nrows, ncols, count));
+    for (int n = 0; n < count; ++n)
+    {
+      if (nrows[n] < 0 || nrows[n] >= m_rows ||
+	  ncols[n] < 0 || ncols[n] >= m_cols)
+	continue;
+      const int j = nrows[n]*m_cols + ncols[n];
+      if (parent[j] < 0) continue;
+      const int a = find_root(parent, i), b = find_root(parent, j);
+      if (a < b) parent[b] = a;
+      else if (b < a) parent[a] = b;
+    }
+  }
+
+  /* Number the openings.  A representative comes before the rest of its set,
+   * so by the time we get to any other patch, its parent already holds the
+   * opening's number, encoded as -2 - number.
+   */
+  int openings = 0;
+  for (int i = 0; i < m_rows*m_cols; ++i)
+  {
+    if (parent[i] == -1) continue;
+    if (parent[i] == i) parent[i] = -2 - openings++;
+    else parent[i] = parent[parent[i]];
+  }
+
+  // Decode the numbers; this leaves -1 as it is
+  for (int i = 0; i < m_rows*m_cols; ++i) labels[i] = -2 - labels[i];
+  return openings;
+}
+
+
+template<typename GRID>
+void BasicLake::measure(const GRID &grid, BoardMetrics &m) const
+{
+  vector<int> labels;
+  m.opening_sizes.assign(label_openings(grid, labels), 0);
+  for (int i = 0; i < m_rows*m_cols; ++i)
+    if (labels[i] >= 0) ++m.opening_sizes[labels[i]];
+
+  // Each number is revealed by the openings it borders on, or else isolated
+  m.isolated = 0;
+  for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+  {
+    const Patch &p = m_patches[grid.index_for(r,c)];
+    if (p.mined() || !p.near_mines()) continue;
+
+    int openings[GRID::topology::neighbours];
+    const int found = openings_near(grid, m_patches, labels, r, c, openings);
+    for (int i = 0; i < found; ++i) ++m.opening_sizes[openings[i]];
+    if (!found) ++m.isolated;
+  }
+
+  m.openings = int(m.opening_sizes.size());
+  m.bbbv = m.openings + m.isolated;
+}
+
+
+void BasicLake::index_openings(bool on)
+{
+  if (!on)
+  {
+    delete m_openings;
+    m_openings = 0;
+  }
+  else if (!m_openings)
+  {
+    // Labelled when first needed
+    m_openings = new OpeningIndex;
+  }
+}
+
+
+template<typename GRID> void BasicLake::build_openings(const GRID &grid)
+{
+  OpeningIndex &x = *m_openings;
+  x.valid = false;
+  const int openings = label_openings(grid, x.labels);
+
+  /* List each opening's patches, including the numbers along its edge, as
+   * offsets (row*cols + col) in row-major order.  A number may border on
+   * several openings, so count first, then fill in.
+   */
+  int near[GRID::topology::neighbours];
+  vector<int> start(openings+1, 0);
+  for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+  {
+    const int o = x.labels[r*m_cols + c];
+    if (o >= 0)
+    {
+      ++start[o+1];
+    }
+    else if (!cell(grid,m_patches,r,c).mined())
+    {
+      const int found = openings_near(grid, m_patches, x.labels, r, c, near);
+      for (int i = 0; i < found; ++i) ++start[near[i]+1];
+    }
+  }
+  for (int o = 0; o < openings; ++o) start[o+1] += start[o];
+
+  vector<int> members(start[openings]);
+  for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+  {
+    const int i = r*m_cols + c, o = x.labels[i];
+    if (o >= 0)
+    {
+      members[start[o]++] = i;
+    }
+    else if (!cell(grid,m_patches,r,c).mined())
+    {
+      const int found = openings_near(grid, m_patches, x.labels, r, c, near);
+      for (int n = 0; n < found; ++n) members[start[near[n]]++] = i;
+    }
+  }
+
+  // Each opening's list now ends where the next one's starts; join up runs
+  x.first.resize(openings+1);
+  x.spans.clear();
+  for (int o = 0, m = 0; o < openings; ++o)
+  {
+    x.first[o] = int(x.spans.size());
+    for (; m < start[o]; ++m)
+    {
+      if (x.first[o] < int(x.spans.size()))
+      {
+	OpeningIndex::Span &last = x.spans.back();
+	if (last.start + last.length == members[m])
+	{
+	  ++last.length;
+	  continue;
+	}
+      }
+      const OpeningIndex::Span run = { members[m], 1 };
+      x.spans.push_back(run);
+    }
+  }
+  x.first[openings] = int(x.spans.size());
+  x.valid = true;
+}
+
+
+template<typename GRID> bool BasicLake::reveal_opening(const GRID &grid,
+	int row,
+	int col,
+	set<Coords> &work,
+	set<Coords> &changes)
+{
+  // Level 1 looks at numbers in the order the waves reach them
+  if (!m_openings || m_intelligence < 2) return false;
+  const Patch &p = cell(grid,m_patches,row,col);
+  if (p.mined() || p.near_mines()) return false;
+  if (!m_openings->valid) build_openings(grid);
+
+  const OpeningIndex &x = *m_openings;
+  const int o = x.labels[row*m_cols + col];
+  typedef vector<OpeningIndex::Span>::const_iterator iter;
+  const iter begin = x.spans.begin() + x.first[o],
+	     end = x.spans.begin() + x.first[o+1];
+
+  /* If the player has already uncovered part of the opening, the waves of
+   * propagate() may not reach all of it.  Leave that case to propagate().
+   */
+  for (iter s = begin; s != end; ++s)
+    for (int i = s->start; i < s->start + s->length; ++i)
+    {
+      const Patch &q = cell(grid,m_patches,i/m_cols,i%m_cols);
+      if (q.revealed() && !q.near_mines()) return false;
+    }
+
+  // Reveal the zeroes; the numbers go to propagate() to apply intelligence
+  for (iter s = begin; s != end; ++s)
+  {
+    int r = s->start / m_cols, c = s->start % m_cols;
+    for (int n = 0; n < s->length; ++n)
+    {
+      if (cell(grid,m_patches,r,c).near_mines())
+      {
+	work.insert(Coords(r,c));
+      }
+      else
+      {
+	reveal_patch(grid,r,c);
+	// Coords sort backwards, so each one goes in at the front
+	changes.insert(changes.begin(), Coords(r,c));
+      }
+      if (++c == m_cols)
+      {
+	c = 0;
+	++r;
+      }
+    }
+  }
+  return true;
+}
+
+
+template<typename GRID>
+void BasicLake::reveal_patch(const GRID &grid, int row, int col)
+{
+  Patch &p = cell(grid,m_patches,row,col);
+  if (!p.revealed())
+  {
+    p.reveal();
+    m_digest ^= patch_key(grid.row_major(row,col), true);
+    const bool number = update_frontier(grid,row,col);
+    const size_t noted = m_obvious.size();
+    for_neighbours(grid,m_patches,row,col,
+	reveal_nearby(*this, p.mined(), number));
+    const bool field = row >= 0 && row < m_rows && col >= 0 && col < m_cols;
+    if (field && p.obvious()) m_obvious.push_back(Coords(row,col));
+
+    // Only level-2 propagation keeps track of these
+    if (m_obvious.size() > noted && (m_intelligence < 2 || !m_settled))
+    {
+      m_obvious.erase(m_obvious.begin() + noted, m_obvious.end());
+      m_settled = false;
+    }
+    if (field && !p.mined()) --m_patches_to_go;
+  }
+}
+
+
+template<typename GRID>
+bool BasicLake::update_frontier(const GRID &grid, int row, int col)
+{
+  const int idx = grid.index_for(row,col);
+  const Patch &p = m_patches[idx];
+  if (p.slot() >= 0) remove_frontier_unknown(idx);
+
+  // Only numbers that the player can see are on the frontier
+  const int margin = GRID::topology::margin;
+  const bool number = !p.mined() &&
+	row >= -margin && row < m_rows+margin &&
+	col >= -margin && col < m_cols+margin;
+  if (number && p.near_unknown()) add_frontier_number(idx);
+  return number;
+}
+
+
+void BasicLake::note_obvious(Coords c) throw ()
+{
+  if (m_intelligence < 2 || !m_settled)
+  {
+    m_settled = false;
+    return;
+  }
+  try
+  {
+    m_obvious.push_back(c);
+  }
+  catch (const exception &)
+  {
+    // Out of memory; fall back on searching for obvious patches instead
+    m_obvious.clear();
+    m_settled = false;
+  }
+}
+
+
+void BasicLake::solve_obvious(set<Coords> &changes)
+{
+  set<Coords> revealed;
+  switch (m_topology)
+  {
+  case square_topology:
+    {
+      BitBoard bits(m_rows, m_cols);
+      for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+      {
+	const Patch &p = m_patches[index_for(r,c)];
+	if (p.mined()) bits.set_mined(r,c);
+	if (p.revealed()) bits.set_revealed(r,c);
+      }
+      bits.solve();
+
+      for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+	if (bits.revealed(r,c) && !m_patches[index_for(r,c)].revealed())
+	  // Coords sort backwards, so this keeps each insertion at the front
+	  revealed.insert(revealed.begin(), Coords(r,c));
+      if (m_layout == blocked_layout)
+	reveal_all(BlockedGrid(m_rows,m_cols), revealed);
+      else
+	reveal_all(SquareGrid(m_rows,m_cols), revealed);
+      // Nothing obvious is left
+      m_obvious.clear();
+      m_settled = true;
+    }
+    break;
+  case hex_topology:
+    solve_cells(HexGrid(m_rows,m_cols), revealed);
+    break;
+  case torus_topology:
+    solve_cells(TorusGrid(m_rows,m_cols), revealed);
+    break;
+  case knight_topology:
+    solve_cells(KnightGrid(m_rows,m_cols), revealed);
+    break;
+  }
+
+  if (revealed.empty()) return;
+  update_hints(revealed);
+  if (m_log) m_log->start(*this);
+  changes.insert(revealed.begin(), revealed.end());
+}
+
+
+template<typename GRID>
+void BasicLake::reveal_all(const GRID &grid, const set<Coords> &patches)
+{
+  for (set<Coords>::const_reverse_iterator i = patches.rbegin();
+       i != patches.rend();
+       ++i)
+    reveal_patch(grid,i->row,i->col);
+}
+
+
+template<typename GRID>
+void BasicLake::solve_cells(const GRID &grid, set<Coords> &changes)
+{
+  // Start from every obvious patch; after that, m_obvious keeps track
+  set<Coords> work;
+  for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+    if (m_patches[grid.index_for(r,c)].obvious()) work.insert(Coords(r,c));
+
+  const int intelligence = m_intelligence;
+  m_intelligence = 2;
+  m_obvious.clear();
+  m_settled = true;
+  try
+  {
+    propagate(grid, work, changes);
+  }
+  catch (const exception &)
+  {
+    m_intelligence = intelligence;
+    m_obvious.clear();
+    m_settled = false;
+    throw;
+  }
+  m_intelligence = intelligence;
+}
+
+
+void BasicLake::check_settled() throw ()
+{
+  m_obvious.clear();
+  m_settled = true;
+  for (int r = 0; r < m_rows && m_settled; ++r)
+    for (int c = 0; c < m_cols; ++c)
+      if (m_patches[index_for(r,c)].obvious())
+      {
+	m_settled = false;
+	break;
+      }
+}
+
+
+void BasicLake::add_frontier_number(int idx) throw ()
+{
+  assert(m_frontier_numbers + m_frontier_unknowns < arraysize());
+  m_patches[idx].set_slot(m_frontier_numbers);
+  m_frontier[m_frontier_numbers++] = idx;
+}
+
+
+void BasicLake::remove_frontier_number(int idx) throw ()
+{
+  const int slot = m_patches[idx].slot(),
+	    last = m_frontier[--m_frontier_numbers];
+  m_frontier[slot] = last;
+  m_patches[last].set_slot(slot);
+  m_patches[idx].set_slot(-1);
+}
+
+
+void BasicLake::add_frontier_unknown(int idx) throw ()
+{
+  assert(m_frontier_numbers + m_frontier_unknowns < arraysize());
+  const int slot = arraysize() - ++m_frontier_unknowns;
+  m_patches[idx].set_slot(slot);
+  m_frontier[slot] = idx;
+}
+
+
+void BasicLake::remove_frontier_unknown(int idx) throw ()
+{
+  const int slot = m_patches[idx].slot(),
+	    last = m_frontier[arraysize() - m_frontier_unknowns--];
+  m_frontier[slot] = last;
+  m_patches[last].set_slot(slot);
+  m_patches[idx].set_slot(-1);
+}
+
+
+Coords BasicLake::coords_for(int idx) const throw ()
+{
+  if (m_layout == blocked_layout)
+  {
+    // Undo BlockedGrid::index_for()
+    const int blocks = (m_cols + 2*border + 7) / 8, block = idx >> 6;
+    return Coords((block/blocks << 3) + ((idx >> 3) & 7) - border,
+	(block%blocks << 3) + (idx & 7) - border);
+  }
+  const int stride = m_cols + 2*border;
+  return Coords(idx/stride - border, idx%stride - border);
+}
+
+
+Coords BasicLake::frontier_number(int i) const
+{
+  if (i < 0 || i >= m_frontier_numbers)
+    throw out_of_range("Frontier number index out of range");
+  return coords_for(m_frontier[i]);
+}
+
+
+Coords BasicLake::frontier_unknown(int i) const
+{
+  if (i < 0 || i >= m_frontier_unknowns)
+    throw out_of_range("Frontier unknown index out of range");
+  return coords_for(m_frontier[arraysize() - 1 - i]);
+}
+
+template<typename GRID> void BasicLake::propagate(const GRID &grid,
+	set<Coords> &work,
+	set<Coords> &changes)
+{
+  while (!work.empty())
+  {
+    set<Coords> next, area;
+
+    /* Reveal any patches from working set with no nearby mines, and their
+     * neighbours.  This part is what all Minesweeper implementations do.
+     */
+    for (set<Coords>::const_iterator i = work.begin(); i != work.end(); ++i)
+    {
+      const int row = i->row, col = i->col;
+      if (row >= 0 && row < m_rows && col >= 0 && col < m_cols)
+      {
+        Patch &p = cell(grid,m_patches,row,col);
+        if (!p.revealed())
+        {
+          reveal_patch(grid,row,col);
+	  changes.insert(Coords(row,col));
+	  // Only the level-2 pass below looks at the area, if it must
+	  if (m_intelligence > 1 && !m_settled)
+            GRID::topology::for_area(grid,m_patches,row,col,
+		set_add<UnfinishedPatch>(area));
+        }
+        if (m_intelligence > 0 && p.obvious())
+          for_neighbours(grid,m_patches,row,col,set_add<UnrevealedPatch>(next));
+      }
+    }
+
+    /* Recognize revealed Patches whose unexplored neighbours must obviously be
+     * either all clear or all mines, and reveal their neighbours.
+     */
+    if (m_intelligence > 1 && m_settled)
+    {
+      // Every patch that became obvious has been noted
+      for (size_t i = 0; i < m_obvious.size(); ++i)
+      {
+	const Coords &c = m_obvious[i];
+	if (cell(grid,m_patches,c.row,c.col).obvious()) next.insert(c);
+      }
+      m_obvious.clear();
+    }
+    else if (m_intelligence > 1)
+    {
+      for (set<Coords>::const_iterator i = area.begin(); i != area.end(); ++i)
+        GRID::topology::for_vicinity(grid,m_patches,i->row,i->col,
+		set_add<ObviousPatch>(next));
+    }
+
+    /* Recognize cases where two patches' sets of nearby unrevealed patches
+     * overlap, such that one of the two difference sets can be concluded to be
+     * mine-free and the other have only mined patches.  One of the two
+     * difference sets may be empty.
+     */
+    if (m_intelligence > 2)
+    {
+      // TODO: TODO: TODO:
+    }
+
+    work.swap(next);
+  }
+}
+
+
+int BasicLake::index_for(int row, int col) const throw ()
+{
+  if (m_layout == blocked_layout)
+    return BlockedGrid(m_rows,m_cols).index_for(row,col);
+  return (row+border)*(m_cols+2*border) + col + border;
+}
+
+
+void BasicLake::check_index(int i) const
+{
+  assert(i >= 0);
+  assert(i < arraysize());
+}
+
+
+void BasicLake::check_pos(int row, int col) const
+{
+  assert(row >= -border);
+  assert(row < m_rows+border);
   assert(col >= -border);
   assert(col < m_cols+border);
 }
 
+
+Lake::Lake(int _rows, int _cols, int mines) :
+  BasicLake(0, 0, 1),
+  m_capacity(0),
+  m_pool(0)
+{
+  start(_rows, _cols, mines, rand_seed(), square_topology, row_major_layout);
+}
+
+
+Lake::Lake(int _rows,
+	int _cols,
+	int mines,
+	unsigned long seed,
+	Topology t,
+	Layout layout) :
+  BasicLake(0, 0, 1),
+  m_capacity(0),
+  m_pool(0)
+{
+  start(_rows, _cols, mines, seed, t, layout);
+}
+
+
+Lake::Lake(LakePool &pool, int _rows, int _cols, int mines) :
+  BasicLake(0, 0, 1),
+  m_capacity(0),
+  m_pool(&pool)
+{
+  start(_rows, _cols, mines, rand_seed(), square_topology, row_major_layout);
+}
+
+
+Lake::Lake(LakePool &pool, int _rows, int _cols, int mines,
+    unsigned long seed, Topology t, Layout layout) :
+  BasicLake(0, 0, 1),
+  m_capacity(0),
+  m_pool(&pool)
+{
+  start(_rows, _cols, mines, seed, t, layout);
+}
+
+
+Lake::Lake(const char buffer[]) :
+  BasicLake(0, 0, 0),
+  m_capacity(0),
+  m_pool(0)
+{
+  try
+  {
+    load_state(buffer);
+  }
+  catch (...)
+  {
+    free_patches();
+    throw;
+  }
+}
+
+
+Lake::Lake(LakePool &pool, const char buffer[]) :
+  BasicLake(0, 0, 0),
+  m_capacity(0),
+  m_pool(&pool)
+{
+  try
+  {
+    load_state(buffer);
+  }
+  catch (...)
+  {
+    free_patches();
+    throw;
+  }
+}
+
+
+void Lake::start(int _rows,
+	int _cols,
+	int mines,
+	unsigned long seed,
+	Topology t,
+	Layout layout)
+{
+  try
+  {
+    reset(_rows, _cols, mines, seed, t, layout);
+  }
+  catch (...)
+  {
+    free_patches();
+    throw;
+  }
+}
+
+
+void Lake::load_state(const char buffer[])
+{
+  bool sparse;
+  const char *const data = read_state_header(buffer, sparse);
+  allocate_patches(arraysize());
+  switch (m_topology)
+  {
+  case square_topology:
+    load_field(SquareGrid(m_rows,m_cols), data, sparse);
+    break;
+  case hex_topology:
+    load_field(HexGrid(m_rows,m_cols), data, sparse);
+    break;
+  case torus_topology:
+    load_field(TorusGrid(m_rows,m_cols), data, sparse);
+    break;
+  case knight_topology:
+    load_field(KnightGrid(m_rows,m_cols), data, sparse);
+    break;
+  }
+}
+
+
+Lake::Lake(Lake &&other) throw () :
+  BasicLake(0, 0, 1),
+  m_capacity(0),
+  m_pool(0)
+{
+  swap(other);
+}
+
+
+Lake::~Lake() throw ()
+{
+  free_patches();
+}
+
+
+Lake &Lake::operator=(Lake &&other) throw ()
+{
+  // Our own game goes away with the temporary
+  Lake old(std::move(other));
+  swap(old);
+  return *this;
+}
+
+
+void Lake::swap(Lake &other) throw ()
+{
+  swap_state(other);
+  std::swap(m_capacity, other.m_capacity);
+  std::swap(m_pool, other.m_pool);
+}
+
+
+void Lake::reusing()
+{
+  // A Lake that's being reset may well be reset again; keep its border handy
+  if (m_patches && !m_blank) m_blank = new BlankField;
+}
+
+
+void Lake::reset(int _rows, int _cols, int mines)
+{
+  reset(_rows, _cols, mines, rand_seed());
+}
+
+
+void Lake::reset(int _rows,
+	int _cols,
+	int mines,
+	unsigned long seed,
+	Topology t,
+	Layout layout)
+{
+  if (!valid_topology(t, _rows, _cols))
+    throw invalid_argument("Invalid topology for this size of playing field");
+  if (layout != row_major_layout && t != square_topology)
+    throw invalid_argument("Only square topology can have blocked layout");
+  reusing();
+  m_rows = _rows;
+  m_cols = _cols;
+  m_topology = t;
+  m_layout = layout;
+  allocate_patches(arraysize());
+  switch (m_topology)
+  {
+  case square_topology:
+    if (m_layout == blocked_layout)
+      new_game(BlockedGrid(m_rows,m_cols), mines, seed);
+    else
+      new_game(SquareGrid(m_rows,m_cols), mines, seed);
+    break;
+  case hex_topology:
+    new_game(HexGrid(m_rows,m_cols), mines, seed);
+    break;
+  case torus_topology:
+    new_game(TorusGrid(m_rows,m_cols), mines, seed);
+    break;
+  case knight_topology:
+    new_game(KnightGrid(m_rows,m_cols), mines, seed);
+    break;
+  }
+}
+
+
+void Lake::reset_tiled(int _rows,
+	int _cols,
+	int mines,
+	unsigned long seed,
+	int threads,
+	Layout layout)
+{
+  if (!valid_topology(square_topology, _rows, _cols))
+    throw invalid_argument("Invalid size for playing field");
+  if (mines < 0 || mines > double(_rows)*_cols)
+    throw invalid_argument("Wrong number of mines for playing field");
+  reusing();
+  m_rows = _rows;
+  m_cols = _cols;
+  m_topology = square_topology;
+  m_layout = layout;
+  allocate_patches(arraysize());
+  if (m_layout == blocked_layout)
+    tile_field(BlockedGrid(m_rows,m_cols), mines, seed, threads);
+  else
+    tile_field(SquareGrid(m_rows,m_cols), mines, seed, threads);
+}
+
+
+template<typename GRID>
+void Lake::tile_field(const GRID &grid,
+	int mines,
+	unsigned long seed,
+	int threads)
+{
+  m_patches_to_go = m_rows*m_cols - mines;
+  m_moves = 0;
+  m_random = seed;
+  init_field(grid);
+
+  if (threads <= 0) threads = thread::hardware_concurrency();
+  if (threads <= 0) threads = 1;
+  vector<vector<Coords> > seams(threads);
+  vector<uint64_t> digests(threads, 0);
+  vector<exception_ptr> failures(threads);
+  vector<thread> helpers;
+  helpers.reserve(threads);
+
+  // Every thread that got started must be joined, whatever goes wrong
+  try
+  {
+    for (int t = 1; t < threads; ++t)
+      helpers.push_back(thread(&Lake::guard_tiles<GRID>, this, grid, t,
+	  threads, mines, seed, &seams[t], &digests[t], &failures[t]));
+    place_tiles(grid, 0, threads, mines, seed, &seams[0], &digests[0]);
+  }
+  catch (...)
+  {
+    failures[0] = current_exception();
+  }
+  for (vector<thread>::iterator h = helpers.begin(); h != helpers.end(); ++h)
+    h->join();
+  for (int t = 0; t < threads; ++t) if (failures[t])
+  {
+    // Leave a clear field behind, not a half-mined one
+    m_patches_to_go = m_rows*m_cols;
+    init_field(grid);
+    rethrow_exception(failures[t]);
+  }
+
+  // Now count the mines near tile edges in the tiles next door
+  const int size = tile_size;
+  for (int t = 0; t < threads; ++t)
+  {
+    m_digest ^= digests[t];
+    for (vector<Coords>::const_iterator i = seams[t].begin();
+	 i != seams[t].end();
+	 ++i)
+    {
+      const int top = i->row/size*size, left = i->col/size*size;
+      bool skipped = false;
+      for_neighbours(grid,m_patches,i->row,i->col,
+	set_tile_nearby_mine(top, left, false, skipped));
+    }
+  }
+
+  if (m_openings) build_openings(grid);
+}
+
+
+template<typename GRID> void Lake::guard_tiles(GRID grid,
+	int first,
+	int step,
+	int mines,
+	unsigned long seed,
+	vector<Coords> *seams,
+	uint64_t *digest,
+	exception_ptr *failure)
+{
+  try
+  {
+    place_tiles(grid, first, step, mines, seed, seams, digest);
+  }
+  catch (...)
+  {
+    *failure = current_exception();
+  }
+}
+
+
+template<typename GRID> void Lake::place_tiles(GRID grid,
+	int first,
+	int step,
+	int mines,
+	unsigned long seed,
+	vector<Coords> *seams,
+	uint64_t *digest)
+{
+  const int size = tile_size,
+	    tilerows = (m_rows + size-1) / size,
+	    tilecols = (m_cols + size-1) / size;
+  const uint64_t cells = uint64_t(m_rows) * m_cols;
+  vector<char> chosen;
+
+  for (int tile = first; tile < tilerows*tilecols; tile += step)
+  {
+    const int top = tile/tilecols*size, left = tile%tilecols*size,
+	      height = min(size, m_rows-top), width = min(size, m_cols-left),
+	      area = height*width;
+
+    /* The tile's share of the mines, in proportion to its area.  Tiles are
+     * numbered row by row, so this counts the patches in tiles before this
+     * one, and gives each tile the mines for the patches up to its end, minus
+     * those for the ones before it.
+     */
+    const uint64_t before = uint64_t(top)*m_cols + uint64_t(height)*left;
+    const int share =
+	int((before + area) * mines / cells - before * mines / cells);
+
+    // Choose whichever is fewer: the mined patches or the clear ones
+    const bool pick_mines = (share <= area/2);
+    const int picks = pick_mines ? share : area - share;
+    chosen.assign(area, 0);
+    const uint64_t key = counter_random(seed, tile);
+    for (uint64_t n = 0, picked = 0; picked < uint64_t(picks); ++n)
+    {
+      const int pos = scale_random(counter_random(key, n), area);
+      if (chosen[pos]) continue;
+      chosen[pos] = 1;
+      ++picked;
+    }
+
+    for (int pos = 0; pos < area; ++pos) if (bool(chosen[pos]) == pick_mines)
+    {
+      const int row = top + pos/width, col = left + pos%width;
+      cell(grid,m_patches,row,col).mine();
+      *digest ^= patch_key(grid.row_major(row,col), false);
+
+      // Other tiles may be working on patches just outside this one
+      bool skipped = false;
+      for_neighbours(grid,m_patches,row,col,
+	set_tile_nearby_mine(top, left, true, skipped));
+      if (skipped) seams->push_back(Coords(row,col));
+    }
+  }
+}
+
+
+void Lake::reset_layout(int _rows, int _cols, const vector<int> &mines)
+{
+  m_rows = _rows;
+  m_cols = _cols;
+  m_topology = square_topology;
+  m_layout = row_major_layout;
+  allocate_patches(arraysize());
+
+  const SquareGrid grid(m_rows,m_cols);
+  m_patches_to_go = m_rows*m_cols;
+  m_moves = 0;
+  init_field(grid);
+  for (vector<int>::const_iterator i = mines.begin(); i != mines.end(); ++i)
+    place_mine_at(grid, *i / m_cols, *i % m_cols);
+}
+
+
+void Lake::move_mine(Coords from, Coords to)
+{
+  assert(m_topology == square_topology);
+  assert(m_layout == row_major_layout);
+  BasicLake::move_mine(SquareGrid(m_rows,m_cols), from, to);
+}
+
+
+void Lake::repropagate(Coords pos, set<Coords> &changes)
+{
+  set<Coords> worklist;
+  worklist.insert(pos);
+  assert(m_topology == square_topology);
+  assert(m_layout == row_major_layout);
+  propagate(SquareGrid(m_rows,m_cols), worklist, changes);
+}
+
+
+void Lake::allocate_patches(int n)
+{
+  if (n <= m_capacity) return;
+
+  // Playing field and frontier index share one block
+  free_patches();
+  size_t bytes = n * (sizeof(Patch) + sizeof(int));
+  void *const mem = m_pool ? m_pool->allocate(bytes) : operator new(bytes);
+  m_patches = static_cast<Patch *>(mem);
+  m_capacity = bytes / (sizeof(Patch) + sizeof(int));
+  m_frontier = reinterpret_cast<int *>(m_patches + m_capacity);
+}
+
+
+void Lake::free_patches() throw ()
+{
+  if (!m_patches) return;
+  if (m_pool)
+    m_pool->release(m_patches, m_capacity*(sizeof(Patch) + sizeof(int)));
+  else
+    operator delete(m_patches);
+  m_patches = 0;
+  m_frontier = 0;
+  m_capacity = 0;
+}
+
+
+void Lake::probe(int row, int col, set<Coords> &changes, bool as_mine)
+{
+  // Pick the game logic compiled for our topology and layout
+  switch (m_topology)
+  {
+  case square_topology:
+    if (m_layout == blocked_layout)
+      BasicLake::probe(BlockedGrid(m_rows,m_cols), row, col, changes, as_mine);
+    else
+      BasicLake::probe(SquareGrid(m_rows,m_cols), row, col, changes, as_mine);
+    break;
+  case hex_topology:
+    BasicLake::probe(HexGrid(m_rows,m_cols), row, col, changes, as_mine);
+    break;
+  case torus_topology:
+    BasicLake::probe(TorusGrid(m_rows,m_cols), row, col, changes, as_mine);
+    break;
+  case knight_topology:
+    BasicLake::probe(KnightGrid(m_rows,m_cols), row, col, changes, as_mine);
+    break;
+  }
+}
+
+
+/// Header of mapped game file, as documented with MappedLake
+struct MappedLake::Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t patchsize;
+  int32_t rows, cols, topology, intelligence, openings;
+  int32_t to_go, moves, frontier_numbers, frontier_unknowns;
+  int32_t in_move;
+  uint64_t random;
+  uint64_t digest;
+};
+
+
+MappedLake::MappedLake(const string &path,
+	int _rows,
+	int _cols,
+	int mines,
+	unsigned long seed,
+	Topology t) :
+  BasicLake(_rows, _cols, 1, t),
+  m_path(path),
+  m_fd(-1),
+  m_map(0),
+  m_mapsize(0)
+{
+  if (_rows <= 0 || _cols <= 0 || !valid_topology(t, _rows, _cols))
+    throw invalid_argument("Invalid size or topology for playing field");
+
+  m_fd = open(path.c_str(), O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+  if (m_fd == -1) map_fail("Could not create " + path);
+  try
+  {
+    if (ftruncate(m_fd, off_t(filesize())) != 0)
+      map_fail("Could not extend " + path);
+    map(filesize());
+    reset(mines, seed);
+  }
+  catch (...)
+  {
+    unmap();
+    close(m_fd);
+    throw;
+  }
+}
+
+
+MappedLake::MappedLake(const string &path) :
+  BasicLake(0, 0, 0),
+  m_path(path),
+  m_fd(-1),
+  m_map(0),
+  m_mapsize(0)
+{
+  m_fd = open(path.c_str(), O_RDWR|O_CLOEXEC);
+  if (m_fd == -1) map_fail("Could not open " + path);
+  try
+  {
+    Header h;
+    const ssize_t bytes = pread(m_fd, &h, sizeof(h), 0);
+    if (bytes < 0) map_fail("Could not read " + path);
+    if (size_t(bytes) < sizeof(h) ||
+	memcmp(h.magic, map_magic, sizeof(h.magic)) != 0 ||
+	h.version != map_version)
+      throw runtime_error("Not a mapped game file: " + path);
+    if (h.patchsize != sizeof(Patch))
+      throw runtime_error("Mapped game file is from an incompatible build: " +
+	  path);
+    if (h.rows <= 0 || h.cols <= 0 ||
+	!valid_topology(Topology(h.topology), h.rows, h.cols))
+      throw runtime_error("Mapped game file has invalid dimensions: " + path);
+    if (h.in_move)
+      throw runtime_error("Mapped game file was left halfway through a move: " +
+	  path);
+
+    m_rows = h.rows;
+    m_cols = h.cols;
+    m_topology = Topology(h.topology);
+    m_intelligence = h.intelligence;
+    m_patches_to_go = h.to_go;
+    m_moves = h.moves;
+    m_frontier_numbers = h.frontier_numbers;
+    m_frontier_unknowns = h.frontier_unknowns;
+    m_random = h.random;
+    m_digest = h.digest;
+    index_openings(h.openings != 0);
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) map_fail("Could not stat " + path);
+    if (uint64_t(st.st_size) != filesize())
+      throw runtime_error("Mapped game file has wrong size: " + path);
+    map(filesize());
+  }
+  catch (...)
+  {
+    unmap();
+    close(m_fd);
+    throw;
+  }
+}
+
+
+MappedLake::~MappedLake() throw ()
+{
+  if (m_map) store_header();
+  unmap();
+  close(m_fd);
+}
+
+
+void MappedLake::reset(int mines, unsigned long seed)
+{
+  begin_move();
+  switch (m_topology)
+  {
+  case square_topology:
+    new_game(SquareGrid(m_rows,m_cols), mines, seed);
+    break;
+  case hex_topology:
+    new_game(HexGrid(m_rows,m_cols), mines, seed);
+    break;
+  case torus_topology:
+    new_game(TorusGrid(m_rows,m_cols), mines, seed);
+    break;
+  case knight_topology:
+    new_game(KnightGrid(m_rows,m_cols), mines, seed);
+    break;
+  }
+  store_header();
+}
+
+
+void MappedLake::probe(int row, int col, set<Coords> &changes, bool as_mine)
+{
+  begin_move();
+  try
+  {
+    switch (m_topology)
+    {
+    case square_topology:
+      BasicLake::probe(SquareGrid(m_rows,m_cols), row, col, changes, as_mine);
+      break;
+    case hex_topology:
+      BasicLake::probe(HexGrid(m_rows,m_cols), row, col, changes, as_mine);
+      break;
+    case torus_topology:
+      BasicLake::probe(TorusGrid(m_rows,m_cols), row, col, changes, as_mine);
+      break;
+    case knight_topology:
+      BasicLake::probe(KnightGrid(m_rows,m_cols), row, col, changes, as_mine);
+      break;
+    }
+  }
+  catch (...)
+  {
+    // A fatal move is a move, too
+    store_header();
+    throw;
+  }
+  store_header();
+}
+
+
+void MappedLake::sync()
+{
+  store_header();
+  if (msync(m_map, m_mapsize, MS_SYNC) != 0)
+    map_fail("Could not flush " + m_path);
+}
+
+
+void MappedLake::map(size_t size)
+{
+  void *const mem = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (mem == MAP_FAILED) map_fail("Could not map " + m_path);
+  m_map = mem;
+  m_mapsize = size;
+  m_patches = reinterpret_cast<Patch *>(static_cast<char *>(mem) +
+	map_header_room);
+  m_frontier = reinterpret_cast<int *>(m_patches + arraysize());
+}
+
+
+void MappedLake::unmap() throw ()
+{
+  if (!m_map) return;
+  munmap(m_map, m_mapsize);
+  m_map = 0;
+  m_patches = 0;
+  m_frontier = 0;
+}
+
+
+void MappedLake::begin_move() throw ()
+{
+  static_cast<Header *>(m_map)->in_move = 1;
+}
+
+
+void MappedLake::store_header() throw ()
+{
+  Header &h = *static_cast<Header *>(m_map);
+  h.version = map_version;
+  h.patchsize = sizeof(Patch);
+  h.rows = m_rows;
+  h.cols = m_cols;
+  h.topology = m_topology;
+  h.intelligence = m_intelligence;
+  h.openings = openings_indexed();
+  h.to_go = m_patches_to_go;
+  h.moves = m_moves;
+  h.frontier_numbers = m_frontier_numbers;
+  h.frontier_unknowns = m_frontier_unknowns;
+  h.random = m_random;
+  h.digest = m_digest;
+  h.in_move = 0;
+  // Written last, so a half-created file is never taken for a game
+  memcpy(h.magic, map_magic, sizeof(h.magic));
+}
+
+
+size_t MappedLake::filesize() const throw ()
+{
+  return map_header_room + size_t(arraysize())*(sizeof(Patch) + sizeof(int));
+}
+
+
+template<int ROWS, int COLS> FixedLake<ROWS,COLS>::FixedLake(int mines) :
+  BasicLake(ROWS, COLS, 1)
+{
+  m_patches = reinterpret_cast<Patch *>(m_field);
+  m_frontier = m_frontier_index;
+  new_game(FixedGrid<ROWS,COLS>(), mines, rand_seed());
+}
+
+
+template<int ROWS, int COLS>
+FixedLake<ROWS,COLS>::FixedLake(int mines, unsigned long seed) :
+  BasicLake(ROWS, COLS, 1)
+{
+  m_patches = reinterpret_cast<Patch *>(m_field);
+  m_frontier = m_frontier_index;
+  new_game(FixedGrid<ROWS,COLS>(), mines, seed);
+}
+
+
+template<int ROWS, int COLS>
+FixedLake<ROWS,COLS>::FixedLake(const char buffer[]) :
+  BasicLake(ROWS, COLS, 0)
+{
+  m_patches = reinterpret_cast<Patch *>(m_field);
+  m_frontier = m_frontier_index;
+  bool sparse;
+  const char *const data = read_state_header(buffer, sparse);
+  if (m_rows != ROWS || m_cols != COLS)
+    throw runtime_error("Saved game does not have the expected dimensions");
+  if (m_topology != square_topology)
+    throw runtime_error("Saved game does not have square topology");
+  load_field(FixedGrid<ROWS,COLS>(), data, sparse);
+}
+
+
+template<int ROWS, int COLS>
+void FixedLake<ROWS,COLS>::reset(int mines, unsigned long seed)
+{
+  new_game(FixedGrid<ROWS,COLS>(), mines, seed);
+}
+
+
+template<int ROWS, int COLS> void FixedLake<ROWS,COLS>::probe(int row,
+	int col,
+	set<Coords> &changes,
+	bool as_mine)
+{
+  BasicLake::probe(FixedGrid<ROWS,COLS>(), row, col, changes, as_mine);
+}
+
+
+template class FixedLake<9,9>;
+template class FixedLake<16,16>;
+template class FixedLake<16,30>;
@@ -0,0 +1,119 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Lock-striped table of games for multi-threaded programs.
+
+#include <cassert>
+
+#include "gametable.hxx"
+
+using namespace std;
+
+namespace
+{
+int round_up_to_power_of_two(int n)
+{
+  int p = 1;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+/// Functor: probe Lake
+class prober
+{
+public:
+  prober(int row, int col, set<Coords> &changes, bool as_mine) :
+    m_row(row), m_col(col), m_changes(changes), m_mine(as_mine) {}
+  void operator()(Lake &L) const { L.probe(m_row,m_col,m_changes,m_mine); }
+
+private:
+  int m_row, m_col;
+  set<Coords> &m_changes;
+  bool m_mine;
+};
+} // namespace
+
+
+GameTable::GameTable(int shards) :
+  m_shards(round_up_to_power_of_two(shards))
+{
+}
+
+
+GameTable::~GameTable() throw ()
+{
+  for (vector<Shard>::iterator s = m_shards.begin(); s != m_shards.end(); ++s)
+    for (map<uint64_t,Lake *>::iterator i = s->games.begin();
+	 i != s->games.end();
+	 ++i)
+      delete i->second;
+}
+
+
+bool GameTable::insert(uint64_t id, Lake *L)
+{
+  assert(L);
+  Shard &s = shard_for(id);
+  lock_guard<mutex> lock(s.lock);
+  return s.games.insert(make_pair(id, L)).second;
+}
+
+
+Lake *GameTable::remove(uint64_t id)
+{
+  Shard &s = shard_for(id);
+  lock_guard<mutex> lock(s.lock);
+  const map<uint64_t,Lake *>::iterator i = s.games.find(id);
+  if (i == s.games.end()) return 0;
+  Lake *const L = i->second;
+  s.games.erase(i);
+  return L;
+}
+
+
+bool GameTable::probe(uint64_t id,
+	int row,
+	int col,
+	set<Coords> &changes,
+	bool as_mine)
+{
+  return apply(id, prober(row,col,changes,as_mine));
+}
+
+
+int GameTable::size()
+{
+  int total = 0;
+  for (vector<Shard>::iterator s = m_shards.begin(); s != m_shards.end(); ++s)
+  {
+    lock_guard<mutex> lock(s->lock);
+    total += s->games.size();
+  }
+  return total;
+}
+
+
+GameTable::Shard &GameTable::shard_for(uint64_t id) throw ()
+{
+  // Mix the bits, so that ids differing only in their high bits spread out
+  id ^= id >> 33;
+  id *= UINT64_C(0xff51afd7ed558ccd);
+  id ^= id >> 33;
+  return m_shards[id & (m_shards.size() - 1)];
+}
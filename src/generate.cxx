@@ -0,0 +1,295 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Generation of boards that can be solved without guessing.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gamelogic.hxx"
+#include "random.hxx"
+
+using namespace std;
+
+namespace
+{
+/// Number of candidate boards to try before giving up
+const long max_candidates = 64;
+
+/// Number of repairs to a candidate before giving up on it
+int max_repairs(int mines)
+{
+  return 4*mines + 100;
+}
+} // namespace
+
+
+/// Search for a board that can be solved without guessing
+/** Candidate boards are numbered.  Each thread takes every n-th candidate, and
+ * the search's result is the lowest-numbered candidate that could be made
+ * solvable.  Since each candidate's outcome depends only on the seed and its
+ * number, the result does not depend on how many threads were used.
+ */
+class SolvableSearch
+{
+public:
+  SolvableSearch(int rows,
+	int cols,
+	int mines,
+	unsigned long seed,
+	Coords first,
+	int intelligence) :
+    m_rows(rows),
+    m_cols(cols),
+    m_mines(mines),
+    m_seed(seed),
+    m_first(first),
+    m_intelligence(intelligence),
+    m_best(max_candidates),
+    m_lock(),
+    m_result()
+  {
+  }
+
+  /// Run search on given number of threads; returns whether it succeeded
+  bool run(int threads);
+
+  /// Mine layout found by successful search
+  const vector<int> &result() const throw () { return m_result; }
+
+private:
+  void work(int thread, int threads);
+  bool try_candidate(Lake &scratch, long candidate, vector<int> &layout) const;
+  /// Does patch have explored, clear neighbours?
+  bool explored_nearby(const Lake &, int row, int col) const;
+  /// List patch's unexplored neighbours; returns whether there are any
+  bool unknown_nearby(const Lake &,
+	int row,
+	int col,
+	vector<int> &unknown) const;
+  bool in_first_zone(int row, int col) const throw ()
+  {
+    return abs(row-m_first.row) <= 1 && abs(col-m_first.col) <= 1;
+  }
+
+  const int m_rows, m_cols, m_mines;
+  const unsigned long m_seed;
+  const Coords m_first;
+  const int m_intelligence;
+
+  /// Lowest-numbered candidate found to be solvable so far
+  atomic<long> m_best;
+  mutex m_lock;
+  vector<int> m_result;
+};
+
+
+bool SolvableSearch::run(int threads)
+{
+  if (threads <= 0) threads = thread::hardware_concurrency();
+  if (threads <= 0) threads = 1;
+
+  vector<thread> helpers;
+  for (int t = 1; t < threads; ++t)
+    helpers.push_back(thread(&SolvableSearch::work, this, t, threads));
+  work(0, threads);
+  for (vector<thread>::iterator h = helpers.begin(); h != helpers.end(); ++h)
+    h->join();
+
+  return m_best < max_candidates;
+}
+
+
+void SolvableSearch::work(int t, int threads)
+{
+  // Candidate boards are played out on a scratch Lake of our own
+  Lake scratch(m_rows, m_cols, 0, 0);
+  vector<int> layout;
+
+  for (long c = t; c < m_best; c += threads)
+  {
+    if (!try_candidate(scratch, c, layout)) continue;
+
+    lock_guard<mutex> lock(m_lock);
+    if (c < m_best)
+    {
+      m_best = c;
+      m_result.swap(layout);
+    }
+    return;
+  }
+}
+
+
+bool SolvableSearch::try_candidate(Lake &scratch,
+	long candidate,
+	vector<int> &layout) const
+{
+  const int cells = m_rows*m_cols;
+  uint64_t random = m_seed ^ (uint64_t(candidate) << 32);
+  splitmix64(random);
+
+  // Scatter mines, keeping the first click and its neighbours clear
+  vector<char> mined(cells, 0);
+  layout.clear();
+  while (int(layout.size()) < m_mines)
+  {
+    const int pos = scale_random(splitmix64(random), cells);
+    if (!mined[pos] && !in_first_zone(pos/m_cols, pos%m_cols))
+    {
+      mined[pos] = 1;
+      layout.push_back(pos);
+    }
+  }
+
+  scratch.reset_layout(m_rows, m_cols, layout);
+  scratch.set_intelligence(m_intelligence);
+  set<Coords> changes;
+  scratch.probe(m_first.row, m_first.col, changes);
+
+  vector<int> edge, deep_clear, deep_mined, unknown;
+  for (int repairs = max_repairs(m_mines); repairs >= 0; --repairs)
+  {
+    if (!scratch.to_go())
+    {
+      // Solved.  Double-check by playing the final layout from scratch.
+      layout.clear();
+      for (int p = 0; p < cells; ++p) if (mined[p]) layout.push_back(p);
+      scratch.reset_layout(m_rows, m_cols, layout);
+      scratch.probe(m_first.row, m_first.col, changes);
+      if (!scratch.to_go()) return true;
+    }
+
+    /* The solver got stuck.  Find the numbers along the edge of the explored
+     * area, where it got stuck, and the "deep" water that has no explored
+     * neighbours yet.
+     */
+    edge.clear();
+    deep_clear.clear();
+    deep_mined.clear();
+    for (int r = 0; r < m_rows; ++r) for (int c = 0; c < m_cols; ++c)
+    {
+      const int pos = r*m_cols + c;
+      const char x = scratch.status_at(r,c);
+      if (x == '^')
+      {
+        if (!in_first_zone(r,c) && !explored_nearby(scratch,r,c))
+	  (mined[pos] ? deep_mined : deep_clear).push_back(pos);
+      }
+      else if (x != '*' && unknown_nearby(scratch,r,c,unknown))
+      {
+	edge.push_back(pos);
+      }
+    }
+    if (edge.empty()) return false;
+
+    /* Make one of those numbers obvious: either move all mines away from its
+     * unexplored neighbours, or fill them all up with mines.  Either way, the
+     * mines are traded with deep water.
+     *
+     * Since the solver never used this number or any other number that still
+     * has unexplored neighbours, everything it concluded so far remains valid.
+     * So rather than starting over, we can just carry on from here.
+     */
+    const int pos = edge[scale_random(splitmix64(random), edge.size())];
+    unknown_nearby(scratch, pos/m_cols, pos%m_cols, unknown);
+    int clear = 0;
+    for (vector<int>::const_iterator i=unknown.begin(); i!=unknown.end(); ++i)
+      clear += !mined[*i];
+    const bool can_clear = size_t(unknown.size()-clear) <= deep_clear.size(),
+	       can_fill = size_t(clear) <= deep_mined.size();
+    if (!can_clear && !can_fill) return false;
+    const bool fill = can_fill && (!can_clear || (splitmix64(random) & 1));
+
+    vector<int> &trade = (fill ? deep_mined : deep_clear);
+    for (vector<int>::const_iterator i=unknown.begin(); i!=unknown.end(); ++i)
+    {
+      if (bool(mined[*i]) == fill) continue;
+      const int t = scale_random(splitmix64(random), trade.size());
+      const int from = (fill ? trade[t] : *i), to = (fill ? *i : trade[t]);
+      scratch.move_mine(Coords(from/m_cols, from%m_cols),
+	  Coords(to/m_cols, to%m_cols));
+      mined[from] = 0;
+      mined[to] = 1;
+      trade[t] = trade.back();
+      trade.pop_back();
+    }
+    scratch.repropagate(Coords(pos/m_cols, pos%m_cols), changes);
+  }
+  return false;
+}
+
+
+bool SolvableSearch::explored_nearby(const Lake &L, int row, int col) const
+{
+  for (int r = max(row-1, 0); r < min(row+2, m_rows); ++r)
+    for (int c = max(col-1, 0); c < min(col+2, m_cols); ++c)
+    {
+      const char x = L.status_at(r,c);
+      if (x != '^' && x != '*') return true;
+    }
+  return false;
+}
+
+
+bool SolvableSearch::unknown_nearby(const Lake &L,
+	int row,
+	int col,
+	vector<int> &unknown) const
+{
+  unknown.clear();
+  for (int r = max(row-1, 0); r < min(row+2, m_rows); ++r)
+    for (int c = max(col-1, 0); c < min(col+2, m_cols); ++c)
+      if (L.status_at(r,c) == '^') unknown.push_back(r*m_cols + c);
+  return !unknown.empty();
+}
+
+
+void Lake::reset_solvable(int _rows,
+	int _cols,
+	int mines,
+	unsigned long seed,
+	Coords first,
+	int intelligence,
+	int threads)
+{
+  if (first.row < 0 || first.row >= _rows ||
+      first.col < 0 || first.col >= _cols)
+    throw out_of_range("First click for solvable board is outside the field");
+
+  // The first click and its neighbours must be clear
+  const int zone = (min(first.row+2, _rows) - max(first.row-1, 0)) *
+	(min(first.col+2, _cols) - max(first.col-1, 0));
+  if (mines > _rows*_cols - zone)
+    throw runtime_error("Too many mines for a board that can be solved "
+	"without guessing");
+
+  SolvableSearch search(_rows, _cols, mines, seed, first, intelligence);
+  if (!search.run(threads))
+    throw runtime_error("Could not generate a board that can be solved "
+	"without guessing");
+
+  reset_layout(_rows, _cols, search.result());
+  m_intelligence = intelligence;
+}
@@ -0,0 +1,236 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Incrementally maintained hints for the player's next move.
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <stdint.h>
+
+#include "hint.hxx"
+
+using namespace std;
+
+namespace
+{
+/// Distance over which a revealed patch may affect other patches' hints
+/** A revealed patch changes the numbers of unexplored neighbours of the
+ * numbers next to it.  Those numbers may be compared to numbers up to two
+ * steps away, whose own unexplored neighbours are one step further away.
+ */
+const int reach = 4;
+
+bool adjacent(Coords a, Coords b)
+{
+  return abs(a.row-b.row) <= 1 && abs(a.col-b.col) <= 1;
+}
+} // namespace
+
+
+HintCache::HintCache(const BasicLake &L) :
+  m_lake(L),
+  m_risk(),
+  m_ranked(),
+  m_unexplored(0),
+  m_hidden_mines(0),
+  m_cursor(0)
+{
+  for (int r = 0; r < L.rows(); ++r) for (int c = 0; c < L.cols(); ++c)
+  {
+    if (!is_unknown(r,c)) continue;
+    ++m_unexplored;
+    m_hidden_mines += L.at(r,c).mined();
+    evaluate(r,c);
+  }
+}
+
+
+void HintCache::update(const set<Coords> &revealed)
+{
+  set<Coords> affected;
+  for (set<Coords>::const_iterator i = revealed.begin();
+       i != revealed.end();
+       ++i)
+  {
+    if (i->row >= 0 && i->row < m_lake.rows() &&
+        i->col >= 0 && i->col < m_lake.cols())
+    {
+      --m_unexplored;
+      m_hidden_mines -= m_lake.at(i->row,i->col).mined();
+    }
+    forget(*i);
+
+    const int top = max(i->row-reach, 0),
+	      bottom = min(i->row+reach+1, m_lake.rows()),
+	      left = max(i->col-reach, 0),
+	      right = min(i->col+reach+1, m_lake.cols());
+    for (int r = top; r < bottom; ++r) for (int c = left; c < right; ++c)
+      if (is_unknown(r,c)) affected.insert(Coords(r,c));
+  }
+
+  for (set<Coords>::const_iterator i = affected.begin();
+       i != affected.end();
+       ++i)
+    evaluate(i->row, i->col);
+}
+
+
+bool HintCache::best(Hint &h)
+{
+  if (!m_lake.to_go()) return false;
+
+  const bool frontier = !m_ranked.empty();
+  if (frontier && !m_ranked.begin()->first)
+  {
+    h.position = m_ranked.begin()->second;
+    h.safe = true;
+    h.risk = 0;
+    return true;
+  }
+
+  // Look for a patch that's not next to any number
+  const int cols = m_lake.cols(), cells = m_lake.rows()*cols;
+  while (m_cursor < cells &&
+	 (!is_unknown(m_cursor/cols, m_cursor%cols) ||
+	  near_number(m_cursor/cols, m_cursor%cols)))
+    ++m_cursor;
+
+  /* Patches that aren't next to a number are all equally likely to be mined.
+   * Their risk is roughly the density of mines in unexplored water.
+   */
+  const int density =
+	int(int64_t(m_hidden_mines) * certain / max(m_unexplored, 1));
+
+  if (m_cursor < cells && (!frontier || density < m_ranked.begin()->first))
+  {
+    h.position = Coords(m_cursor/cols, m_cursor%cols);
+    h.risk = double(density) / certain;
+  }
+  else
+  {
+    assert(frontier);
+    h.position = m_ranked.begin()->second;
+    h.risk = double(m_ranked.begin()->first) / certain;
+  }
+  h.safe = false;
+  return true;
+}
+
+
+void HintCache::evaluate(int row, int col)
+{
+  const Coords pos(row,col);
+  forget(pos);
+  if (!is_unknown(row,col)) return;
+
+  const int risk = assess(row,col);
+
+  // Leave out patches that aren't next to a number, or are certainly mined
+  if (risk < 0 || risk >= certain) return;
+
+  m_risk.insert(make_pair(pos, risk));
+  m_ranked.insert(make_pair(risk, pos));
+}
+
+
+void HintCache::forget(Coords pos)
+{
+  const map<Coords,int>::iterator i = m_risk.find(pos);
+  if (i == m_risk.end()) return;
+  m_ranked.erase(make_pair(i->second, pos));
+  m_risk.erase(i);
+}
+
+
+int HintCache::assess(int row, int col) const
+{
+  const Coords pos(row,col);
+  int risk = -1;
+
+  // What do the numbers next to this patch tell us individually?
+  for (int br=row-1; br<=row+1; ++br) for (int bc=col-1; bc<=col+1; ++bc)
+  {
+    if (!is_number(br,bc)) continue;
+    const Patch &b = m_lake.at(br,bc);
+    if (!b.near_hiddenmines()) return 0;
+    if (b.near_hiddenmines() == b.near_unknown()) return certain;
+    risk = max(risk, b.near_hiddenmines()*certain / b.near_unknown());
+  }
+  if (risk < 0) return risk;
+
+  /* If some number a's unexplored neighbours are all next to number b as well,
+   * then b's remaining unexplored neighbours must hold the difference between
+   * the two numbers' hidden mines.  If that's zero, they're all clear; if it
+   * equals the number of patches, they're all mined.
+   */
+  for (int br=row-1; br<=row+1; ++br) for (int bc=col-1; bc<=col+1; ++bc)
+  {
+    if (!is_number(br,bc)) continue;
+    const Coords bpos(br,bc);
+    const Patch &b = m_lake.at(br,bc);
+    for (int ar=br-2; ar<=br+2; ++ar) for (int ac=bc-2; ac<=bc+2; ++ac)
+    {
+      const Coords apos(ar,ac);
+      if (adjacent(apos, pos) || !is_number(ar,ac)) continue;
+      const Patch &a = m_lake.at(ar,ac);
+      if (!a.near_unknown() || !unknowns_within(apos, bpos)) continue;
+
+      const int diff = b.near_hiddenmines() - a.near_hiddenmines();
+      if (!diff) return 0;
+      if (diff == b.near_unknown() - a.near_unknown()) return certain;
+    }
+  }
+
+  return risk;
+}
+
+
+bool HintCache::is_number(int row, int col) const
+{
+  if (row < -1 || row > m_lake.rows() || col < -1 || col > m_lake.cols())
+    return false;
+  const Patch &p = m_lake.at(row,col);
+  return p.revealed() && !p.mined();
+}
+
+
+bool HintCache::is_unknown(int row, int col) const
+{
+  return row >= 0 && row < m_lake.rows() &&
+	col >= 0 && col < m_lake.cols() &&
+	!m_lake.at(row,col).revealed();
+}
+
+
+bool HintCache::near_number(int row, int col) const
+{
+  for (int r = row-1; r <= row+1; ++r) for (int c = col-1; c <= col+1; ++c)
+    if (is_number(r,c)) return true;
+  return false;
+}
+
+
+bool HintCache::unknowns_within(Coords a, Coords b) const
+{
+  for (int r = a.row-1; r <= a.row+1; ++r)
+    for (int c = a.col-1; c <= a.col+1; ++c)
+      if (is_unknown(r,c) && !adjacent(Coords(r,c), b)) return false;
+  return true;
+}
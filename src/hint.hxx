@@ -0,0 +1,81 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <map>
+#include <set>
+#include <utility>
+
+#include "gamelogic.hxx"
+
+/// Analysis behind BasicLake::hint(), kept up to date as the game progresses
+/** For every unexplored patch next to a number, keeps an estimate of the risk
+ * that it is mined, ranked so that the safest patch can be found right away.
+ * When patches are revealed, only the estimates for patches close enough to
+ * them to be affected are recomputed.
+ *
+ * Unexplored patches that are not next to any number all carry the same risk,
+ * so they need no bookkeeping; we find one by scanning ahead from where we
+ * found the previous one.  Patches never go back from being explored, or from
+ * being next to a number, so the scan never needs to look at a patch twice.
+ */
+class HintCache
+{
+public:
+  explicit HintCache(const BasicLake &);
+
+  /// Update analysis after given patches were revealed
+  void update(const std::set<Coords> &revealed);
+
+  /// Produce best hint; false if nothing left to explore
+  bool best(Hint &);
+
+private:
+  /// Risk representing certainty that a patch is mined
+  enum { certain = 1 << 16 };
+
+  /// Recompute risk for given patch, and update its ranking
+  void evaluate(int row, int col);
+  /// Remove patch from ranking
+  void forget(Coords);
+  /// Risk that unexplored patch is mined, or -1 if it's not next to a number
+  int assess(int row, int col) const;
+
+  /// Is this a visible, revealed, clear patch?
+  bool is_number(int row, int col) const;
+  /// Is this an unexplored patch inside the playing field?
+  bool is_unknown(int row, int col) const;
+  /// Is there a number next to this patch?
+  bool near_number(int row, int col) const;
+  /// Are all of a's unexplored neighbours also neighbours of b?
+  bool unknowns_within(Coords a, Coords b) const;
+
+  const BasicLake &m_lake;
+
+  /// Current risk estimate for each unexplored patch next to a number
+  std::map<Coords,int> m_risk;
+  /// Same information as m_risk, but ordered by increasing risk
+  std::set<std::pair<int,Coords> > m_ranked;
+
+  /// Number of unexplored patches in playing field
+  int m_unexplored;
+  /// Number of unexplored patches in playing field that are mined
+  int m_hidden_mines;
+  /// Where to continue looking for patches not next to any number
+  int m_cursor;
+};
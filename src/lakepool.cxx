@@ -0,0 +1,153 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Slab allocator for Lakes and their playing fields.
+
+#include <cassert>
+#include <new>
+
+#include "gamelogic.hxx"
+
+using namespace std;
+
+namespace
+{
+/// Smallest block handed out is 2^minclass bytes (must fit a pointer)
+const int minclass = 6;
+
+/// Preferred size of a slab; larger blocks get a slab all to themselves
+const size_t slabsize = 64*1024;
+} // namespace
+
+
+LakePool::LakePool() :
+  m_slabs()
+{
+  for (int c = 0; c < size_classes; ++c) m_free[c] = 0;
+}
+
+
+LakePool::~LakePool() throw ()
+{
+  for (vector<void *>::iterator i = m_slabs.begin(); i != m_slabs.end(); ++i)
+    operator delete(*i);
+}
+
+
+Lake *LakePool::create(int rows, int cols, int mines)
+{
+  size_t bytes = sizeof(Lake);
+  void *const mem = allocate(bytes);
+  try
+  {
+    return new (mem) Lake(*this, rows, cols, mines);
+  }
+  catch (...)
+  {
+    release(mem, bytes);
+    throw;
+  }
+}
+
+
+Lake *LakePool::create(int rows, int cols, int mines, unsigned long seed)
+{
+  size_t bytes = sizeof(Lake);
+  void *const mem = allocate(bytes);
+  try
+  {
+    return new (mem) Lake(*this, rows, cols, mines, seed);
+  }
+  catch (...)
+  {
+    release(mem, bytes);
+    throw;
+  }
+}
+
+
+Lake *LakePool::load(const char buffer[])
+{
+  size_t bytes = sizeof(Lake);
+  void *const mem = allocate(bytes);
+  try
+  {
+    return new (mem) Lake(*this, buffer);
+  }
+  catch (...)
+  {
+    release(mem, bytes);
+    throw;
+  }
+}
+
+
+void LakePool::destroy(Lake *L) throw ()
+{
+  if (!L) return;
+  L->~Lake();
+  release(L, sizeof(Lake));
+}
+
+
+void *LakePool::allocate(size_t &bytes)
+{
+  const int c = size_class(bytes);
+  if (!m_free[c]) add_slab(c);
+
+  void *const block = m_free[c];
+  m_free[c] = *static_cast<void **>(block);
+  bytes = size_t(1) << c;
+  return block;
+}
+
+
+void LakePool::release(void *block, size_t bytes) throw ()
+{
+  if (block) push_block(size_class(bytes), block);
+}
+
+
+int LakePool::size_class(size_t bytes) throw ()
+{
+  int c = minclass;
+  while ((size_t(1) << c) < bytes) ++c;
+  assert(c < size_classes);
+  return c;
+}
+
+
+void LakePool::add_slab(int c)
+{
+  const size_t blocksize = size_t(1) << c;
+  const size_t blocks = (blocksize < slabsize) ? slabsize/blocksize : 1;
+
+  m_slabs.reserve(m_slabs.size() + 1);
+  char *const slab = static_cast<char *>(operator new(blocks*blocksize));
+  m_slabs.push_back(slab);
+
+  for (size_t i = blocks; i > 0; --i) push_block(c, slab + (i-1)*blocksize);
+}
+
+
+void LakePool::push_block(int c, void *block) throw ()
+{
+  *static_cast<void **>(block) = m_free[c];
+  m_free[c] = block;
+}
@@ -0,0 +1,71 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdint.h>
+
+/// Advance SplitMix64 generator state and return its next output
+/** Tiny state, fast, and good enough to scatter mines.
+ */
+inline uint64_t splitmix64(uint64_t &state) throw ()
+{
+  uint64_t z = (state += UINT64_C(0x9e3779b97f4a7c15));
+  z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+/// Counter-based random number: output number n of the stream given by key
+/** Any output can be had directly, without going through the ones before it,
+ * so the work of drawing from many streams can be split up any way we like.
+ */
+inline uint64_t counter_random(uint64_t key, uint64_t n) throw ()
+{
+  uint64_t state = key + n * UINT64_C(0x9e3779b97f4a7c15);
+  return splitmix64(state);
+}
+
+/// Map random 64-bit number onto [0, top) without a division
+inline int scale_random(uint64_t z, int top) throw ()
+{
+  return int(((z >> 32) * uint64_t(top)) >> 32);
+}
+
+/// Scatter mines over a field, the way every kind of game does it
+/** Draws a row and then a column for each position it tries, and calls
+ * f(row,col) to place a mine there.  The functor returns false if the patch
+ * was already mined, in which case that try doesn't count.  Sharing this one
+ * loop means that the same seed gives the same board everywhere.
+ *
+ * Returns the generator's state after the last draw.
+ */
+template<typename FUNCT> inline uint64_t scatter_mines(uint64_t seed,
+	int rows,
+	int cols,
+	int mines,
+	FUNCT f)
+{
+  uint64_t random = seed;
+  while (mines)
+  {
+    const int row = scale_random(splitmix64(random), rows),
+	      col = scale_random(splitmix64(random), cols);
+    mines -= f(row,col);
+  }
+  return random;
+}
@@ -0,0 +1,240 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+// Recording and replaying of games.
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "replay.hxx"
+#include "save.hxx"
+
+using namespace std;
+
+namespace
+{
+/// Header at start of saved log--we may change the format later
+const string logheader = "#mines-log 0.1\n";
+
+void format_error(const string &msg)
+{
+  throw runtime_error("Move log format error: " + msg);
+}
+
+/// Check that number was parsed correctly, and move past it
+void skip_number(const char *&here, const char *end)
+{
+  if (end == here || errno) format_error("bad number");
+  if (*end && !isspace(*end)) format_error("unexpected data after number");
+  here = end;
+}
+
+/// Read decimal number from log
+long read_number(const char *&here)
+{
+  here = skip_whitespace(here);
+  char *end;
+  errno = 0;
+  const long result = strtol(here, &end, 10);
+  skip_number(here, end);
+  return result;
+}
+
+/// Read hexadecimal game fingerprint from log
+uint64_t read_digest(const char *&here)
+{
+  here = skip_whitespace(here);
+  char *end;
+  errno = 0;
+  const unsigned long long result = strtoull(here, &end, 16);
+  skip_number(here, end);
+  return result;
+}
+
+void diverged(int move, const char what[])
+{
+  char buf[100];
+  sprintf(buf, "Replay diverged from log at move %d: %s", move, what);
+  throw runtime_error(buf);
+}
+} // namespace
+
+
+MoveLog::MoveLog(int checkpoint_interval) :
+  m_start(),
+  m_moves(),
+  m_interval(checkpoint_interval),
+  m_checkpoints()
+{
+  if (checkpoint_interval < 0)
+    throw invalid_argument("Negative checkpoint interval");
+}
+
+
+MoveLog::MoveLog(const char buf[]) :
+  m_start(),
+  m_moves(),
+  m_interval(0),
+  m_checkpoints()
+{
+  if (strncmp(buf, logheader.c_str(), logheader.size()) != 0)
+    throw runtime_error("Move log not in recognized format");
+  const char *here = buf + logheader.size();
+
+  m_interval = read_int("intv", here);
+  if (m_interval < 0) format_error("negative checkpoint interval");
+
+  const int snapsize = read_int("snap", here);
+  if (snapsize < 0 || *here != '\n') format_error("bad snapshot size");
+  ++here;
+  if (memchr(here, '\0', snapsize)) format_error("truncated snapshot");
+  m_start.assign(here, snapsize);
+  here += snapsize;
+
+  const int moves = read_int("movs", here);
+  if (moves < 0) format_error("negative number of moves");
+  m_moves.resize(moves);
+  for (int i = 0; i < moves; ++i)
+  {
+    Move &m = m_moves[i];
+    m.row = int(read_number(here));
+    m.col = int(read_number(here));
+    const long flags = read_number(here);
+    m.intelligence = static_cast<unsigned char>(flags >> 1);
+    m.as_mine = flags & 1;
+    m.to_go = int(read_number(here));
+  }
+
+  const int checkpoints = read_int("chks", here);
+  if (checkpoints != (m_interval ? moves/m_interval : 0))
+    format_error("wrong number of checkpoints");
+  m_checkpoints.resize(checkpoints);
+  for (int i = 0; i < checkpoints; ++i)
+    m_checkpoints[i] = read_digest(here);
+
+  read_terminator(here);
+}
+
+
+void MoveLog::start(const BasicLake &lake)
+{
+  vector<char> buf(lake.savesize());
+  const int len = lake.save(&buf[0]);
+  m_start.assign(&buf[0], len);
+  m_moves.clear();
+  m_checkpoints.clear();
+}
+
+
+void MoveLog::record(const BasicLake &lake, Coords pos, bool as_mine,
+	int to_go)
+{
+  Move m;
+  m.row = pos.row;
+  m.col = pos.col;
+  m.to_go = to_go;
+  m.intelligence = static_cast<unsigned char>(lake.intelligence());
+  m.as_mine = as_mine;
+  m_moves.push_back(m);
+
+  if (m_interval && m_moves.size() % m_interval == 0)
+    m_checkpoints.push_back(lake.digest());
+}
+
+
+int MoveLog::savesize() const throw ()
+{
+  // Four numbers per move, each up to 11 characters plus separator
+  return int(logheader.size() + m_start.size() +
+	48*m_moves.size() + 17*m_checkpoints.size()) + 100;
+}
+
+
+int MoveLog::save(char buf[]) const
+{
+  char *here = buf;
+  strcpy(here, logheader.c_str());
+  here += logheader.size();
+  here = write_int("intv", here, m_interval);
+  here = write_int("snap", here, int(m_start.size()));
+  memcpy(here, m_start.data(), m_start.size());
+  here += m_start.size();
+
+  here = write_int("movs", here, moves());
+  for (vector<Move>::const_iterator i = m_moves.begin();
+       i != m_moves.end();
+       ++i)
+    here += sprintf(here, "%d %d %d %d\n",
+	i->row, i->col, i->intelligence<<1 | i->as_mine, i->to_go);
+
+  here = write_int("chks", here, int(m_checkpoints.size()));
+  for (vector<uint64_t>::const_iterator i = m_checkpoints.begin();
+       i != m_checkpoints.end();
+       ++i)
+    here += sprintf(here, "%016llx\n", static_cast<unsigned long long>(*i));
+
+  terminate(here);
+  return here - buf;
+}
+
+
+Lake *MoveLog::replay(bool verify) const
+{
+  Lake *const lake = new Lake(m_start.c_str());
+  try
+  {
+    // Reuse one changes set, so replaying doesn't spend its time allocating
+    set<Coords> changes;
+    vector<uint64_t>::const_iterator checkpoint = m_checkpoints.begin();
+    for (int i = 0; i < moves(); ++i)
+    {
+      const Move &m = m_moves[i];
+      lake->set_intelligence(m.intelligence);
+      int to_go = -1;
+      try
+      {
+	changes.clear();
+	lake->probe(m.row, m.col, changes, m.as_mine);
+	to_go = lake->to_go();
+      }
+      catch (const Boom &)
+      {
+      }
+
+      if (verify)
+      {
+	if (to_go != m.to_go) diverged(i, "different outcome");
+	if (m_interval && (i+1) % m_interval == 0 &&
+	    lake->digest() != *checkpoint++)
+	  diverged(i, "different game state at checkpoint");
+      }
+    }
+  }
+  catch (...)
+  {
+    delete lake;
+    throw;
+  }
+  return lake;
+}
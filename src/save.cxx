@@ -22,6 +22,10 @@ Suite 330, Boston, MA  02111-1307  USA
  */
 
 #include <cassert>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 
@@ -31,59 +35,67 @@ using namespace std;
 
 namespace
 {
-/// Header at start of saved file--we may change the format later
-const string saveheader = "#mines 0.2\n";
+/// Headers at start of saved file, indexed by SaveFormat
+const string saveheader[] = { "#mines 0.2\n", "#mines 0.3\n" };
 
-unsigned char encode[64], decode[256];
-volatile bool encoding_initialized = false;
+/// Encoding table: the 64 characters used in our base64 data, in order
+const char encode[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-int init_range(char first, char last, int n)
-{
-  for (unsigned char i=first; i <= last; ++i, ++n)
-  {
-    encode[n] = i;
-    decode[i] = n;
-  }
-  return n;
-}
-}
+/// Marker for characters that do not occur in our base64 encoding
+enum { X = 0xff };
 
-
-void initialize_encoding()
+/// Decoding table: inverse of encode, with X for invalid characters
+/** This is a constant table rather than one built at runtime, so that it can
+ * be shared by any number of threads without synchronization.
+ */
+const unsigned char decode[256] =
 {
-  if (encoding_initialized) return;
-
-  int n = 0;
-  n = init_range('A','Z',n);
-  n = init_range('a','z',n);
-  n = init_range('0','9',n);
-  n = init_range('+','+',n);
-  n = init_range('/','/',n);
-  assert(n == 64);
-
-  encoding_initialized = true;
-}
-
-
-char *write_header(char *here)
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, 62, X, X, X, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61, X, X, X, X, X, X,
+  X, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, X, X, X, X, X,
+  X, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+  X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X
+};
+} // namespace
+
+
+char *write_header(char *here, SaveFormat format)
 {
-  strcpy(here,saveheader.c_str());
-  return here + saveheader.size();
+  strcpy(here,saveheader[format].c_str());
+  return here + saveheader[format].size();
 }
 
 
-const char *read_header(const char *here)
+const char *read_header(const char *here, SaveFormat &format)
 {
-  if (strncmp(here,saveheader.c_str(),saveheader.size()) != 0)
-    throw runtime_error("Saved game not in recognized format");
-  return here + saveheader.size();
+  for (int f = dense_format; f <= sparse_format; ++f)
+  {
+    if (strncmp(here,saveheader[f].c_str(),saveheader[f].size()) == 0)
+    {
+      format = SaveFormat(f);
+      return here + saveheader[f].size();
+    }
+  }
+  throw runtime_error("Saved game not in recognized format");
 }
 
 
 unsigned int extract_char(const char *&here)
 {
   const unsigned char c = *here++;
-  if (!decode[c] && c != encode[0])
+  if (decode[c] == X)
     throw runtime_error("Unexpected character in data block: '" +
 	string(here-1,here) + "'");
   return decode[c];
@@ -92,10 +104,43 @@ unsigned int extract_char(const char *&here)
 char produce_char(unsigned int x)
 {
   assert(x < 64);
-  assert(encode[x]);
   return encode[x];
 }
 
+int varint_size(unsigned long val) throw ()
+{
+  int chars = 1;
+  for (val >>= varint_bits; val; val >>= varint_bits) ++chars;
+  return chars;
+}
+
+
+char *write_varint(char *here, unsigned long val)
+{
+  const unsigned int more = 1 << varint_bits, mask = more - 1;
+  for (; val > mask; val >>= varint_bits)
+    *here++ = produce_char((val & mask) | more);
+  *here++ = produce_char(val);
+  return here;
+}
+
+
+unsigned long read_varint(const char *&here)
+{
+  const unsigned int more = 1 << varint_bits, mask = more - 1;
+  here = skip_whitespace(here);
+  unsigned long val = 0;
+  for (int shift = 0; ; shift += varint_bits)
+  {
+    if (shift >= int(8*sizeof(val)))
+      throw runtime_error("Saved game format error: number too large");
+    const unsigned int x = extract_char(here);
+    val |= static_cast<unsigned long>(x & mask) << shift;
+    if (!(x & more)) return val;
+  }
+}
+
+
 const char *skip_whitespace(const char *here)
 {
   while (*here && isspace(*here)) ++here;
@@ -120,6 +165,18 @@ int read_int(const char key[], const char *&here)
 }
 
 
+int read_optional_int(const char key[], const char *&here, int fallback)
+{
+  const size_t keylen = 4;
+  assert(strlen(key)==keylen);
+
+  // A key is always followed by a space, which base64 data never contains
+  const char *const start = skip_whitespace(here);
+  if (strncmp(key,start,keylen) != 0 || start[keylen] != ' ') return fallback;
+  return read_int(key, here);
+}
+
+
 char *write_int(const char key[], char *here, int val)
 {
   const size_t keylen = 4;
@@ -19,11 +19,17 @@ Suite 330, Boston, MA  02111-1307  USA
 
 enum { patchesperchar = 3 };
 
-/// Call this to initialize encoding tables (lazy; should be threadsafe)
-void initialize_encoding();
+/// Layouts for a saved game's data block
+enum SaveFormat
+{
+  /// Two bits per patch ("is mined" and "has been revealed"), row by row
+  dense_format,
+  /// Positions of mines, and runs of revealed patches, as varint deltas
+  sparse_format
+};
 
-char *write_header(char *);
-const char *read_header(const char *);
+char *write_header(char *, SaveFormat);
+const char *read_header(const char *, SaveFormat &);
 
 /// Write a newline to output buffer
 char *write_newline(char *);
@@ -34,6 +40,8 @@ const char *skip_whitespace(const char *);
 char *write_int(const char key[], char *here, int val);
 /// Read key string with integer value from input buffer
 int read_int(const char key[], const char *&here);
+/// Read key string with integer value if present, or return fallback
+int read_optional_int(const char key[], const char *&here, int fallback);
 
 /// End-of-line padding mandated by base64
 int linepadding(int bitsperline);
@@ -48,6 +56,16 @@ unsigned int extract_char(const char *&);
 /// Convert a binary value to a single encoding character
 char produce_char(unsigned int);
 
+/// Payload bits per character in a varint; the remaining bit means "more"
+enum { varint_bits = 5 };
+
+/// Number of characters needed to write a varint
+int varint_size(unsigned long) throw ();
+/// Write unsigned number as varint, lowest-order bits first
+char *write_varint(char *, unsigned long);
+/// Read varint, skipping any whitespace before it
+unsigned long read_varint(const char *&);
+
 /// Write terminating zero to output buffer
 void terminate(char *);
 /// Verify that end-of-file happens where we expect it
@@ -0,0 +1,152 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Write-behind queue of games to be stored in an archive.
+
+#include <stdexcept>
+
+#include "savequeue.hxx"
+
+using namespace std;
+
+
+SaveQueue::SaveQueue(const string &path, bool durable) :
+  m_archive(path, durable),
+  m_lock(),
+  m_work(),
+  m_written(),
+  m_queue(),
+  m_queued(0),
+  m_stored(0),
+  m_error(),
+  m_retry(false),
+  m_stop(false),
+  m_writer(&SaveQueue::run, this)
+{
+}
+
+
+SaveQueue::~SaveQueue() throw ()
+{
+  {
+    lock_guard<mutex> lock(m_lock);
+    m_stop = true;
+    m_retry = true;
+  }
+  m_work.notify_one();
+  m_writer.join();
+}
+
+
+void SaveQueue::store(uint64_t id, const BasicLake &lake)
+{
+  vector<char> state(lake.savesize());
+  state.resize(lake.save(&state[0]));
+  enqueue(id, state);
+}
+
+
+void SaveQueue::store(uint64_t id, const char state[], size_t length)
+{
+  vector<char> copy(state, state+length);
+  enqueue(id, copy);
+}
+
+
+void SaveQueue::enqueue(uint64_t id, vector<char> &state)
+{
+  if (state.empty()) throw invalid_argument("Empty game state");
+  {
+    lock_guard<mutex> lock(m_lock);
+    // If the game was already waiting, its older state is never written
+    m_queue[id].swap(state);
+    ++m_queued;
+    m_retry = true;
+  }
+  m_work.notify_one();
+}
+
+
+void SaveQueue::flush()
+{
+  unique_lock<mutex> lock(m_lock);
+  const uint64_t target = m_queued;
+  if (!m_error.empty())
+  {
+    m_retry = true;
+    m_work.notify_one();
+  }
+  while (m_stored < target && (m_error.empty() || m_retry))
+    m_written.wait(lock);
+  if (m_stored < target) throw runtime_error(m_error);
+}
+
+
+size_t SaveQueue::pending()
+{
+  lock_guard<mutex> lock(m_lock);
+  return m_queue.size();
+}
+
+
+void SaveQueue::run() throw ()
+{
+  unique_lock<mutex> lock(m_lock);
+  for (;;)
+  {
+    // After a failure, wait for a reason to try again
+    if (m_queue.empty() || (!m_error.empty() && !m_retry))
+    {
+      if (m_stop) return;
+      m_work.wait(lock);
+      continue;
+    }
+
+    // Take everything that's queued, so it can all share one flush to disk
+    Batch batch;
+    batch.swap(m_queue);
+    const uint64_t covered = m_queued;
+    m_retry = false;
+    lock.unlock();
+
+    string error;
+    try
+    {
+      m_archive.store(batch);
+    }
+    catch (const exception &e)
+    {
+      error = e.what();
+    }
+
+    lock.lock();
+    if (error.empty())
+    {
+      m_stored = covered;
+      m_error.clear();
+    }
+    else
+    {
+      // Requeue, except for games that were stored again in the meantime
+      m_queue.insert(batch.begin(), batch.end());
+      m_error = error;
+    }
+    m_written.notify_all();
+  }
+}
@@ -0,0 +1,138 @@
+/*
+This file is part of libmines.
+
+Copyright (C) 2005-2022, Jeroen T. Vermeulen.
+
+libmines is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later
+version.
+
+libmines is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+libmines; if not, write to the Free Software Foundation, Inc., 59 Temple Place,
+Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+// A single board, probed by many threads at the same time.
+
+#include <stdexcept>
+
+#include "random.hxx"
+#include "sharedlake.hxx"
+
+using namespace std;
+
+
+class SharedLake::place_mine
+{
+public:
+  explicit place_mine(SharedLake &lake) : m_lake(lake) {}
+  bool operator()(int row, int col) const
+  {
+    const int k = m_lake.index_for(row,col), stride = m_lake.m_cols + 2;
+    atomic<unsigned char> &m = m_lake.m_cells[k];
+    if (m & mined_bit) return false;
+    m |= mined_bit;
+    for (int dr = -stride; dr <= stride; dr += stride)
+      for (int dc = -1; dc <= 1; ++dc)
+	if (dr || dc) ++m_lake.m_cells[k+dr+dc];
+    return true;
+  }
+
+private:
+  SharedLake &m_lake;
+};
+
+
+SharedLake::SharedLake(int rows, int cols, int mines, unsigned long seed) :
+  m_rows(rows),
+  m_cols(cols),
+  m_cells(),
+  m_to_go(rows*cols - mines),
+  m_moves(0),
+  m_booms(0)
+{
+  if (rows <= 0 || cols <= 0)
+    throw invalid_argument("Invalid playing field dimensions");
+  if (mines < 0 || mines > rows*cols)
+    throw invalid_argument("Number of mines does not fit on board");
+
+  // The border counts as revealed, so cascades stop there by themselves
+  vector<atomic<unsigned char> > cells((rows+2)*(cols+2));
+  m_cells.swap(cells);
+  for (size_t i = 0; i < m_cells.size(); ++i) m_cells[i] = revealed_bit;
+  for (int r = 0; r < rows; ++r) for (int c = 0; c < cols; ++c)
+    m_cells[index_for(r,c)] = 0;
+
+  scatter_mines(seed, rows, cols, mines, place_mine(*this));
+}
+
+
+char SharedLake::status_at(int row, int col) const
+{
+  check_pos(row, col);
+  const unsigned char p = m_cells[index_for(row,col)];
+  if (!(p & revealed_bit)) return '^';
+  if (p & mined_bit) return '*';
+  return '0' + (p & near_mask);
+}
+
+
+void SharedLake::probe(int row, int col, set<Coords> &changes)
+{
+  check_pos(row, col);
+  const int k = index_for(row,col);
+
+  /* Whoever flips a patch's revealed bit owns it.  Nothing else about a patch
+   * ever changes, so no ordering beyond that of the bit itself is needed.
+   */
+  const unsigned char p = m_cells[k].fetch_or(revealed_bit);
+  if (p & revealed_bit) return;
+
+  const int moves = ++m_moves;
+  const Coords pos(row,col);
+  if (p & mined_bit)
+  {
+    ++m_booms;
+    changes.insert(pos);
+    throw Boom(pos, moves, true);
+  }
+
+  const int stride = m_cols + 2;
+  const int offsets[] =
+	{ -stride-1, -stride, -stride+1, -1, 1, stride-1, stride, stride+1 };
+
+  // Patches we revealed, whose neighbours may still need revealing
+  vector<int> work(1, k);
+  int revealed = 0;
+  while (!work.empty())
+  {
+    const int i = work.back();
+    work.pop_back();
+    ++revealed;
+    changes.insert(coords_for(i));
+    if (m_cells[i].load(memory_order_relaxed) & near_mask) continue;
+
+    // Neighbours of a patch with no mines around it are never mined
+    for (int n = 0; n < 8; ++n)
+    {
+      atomic<unsigned char> &q = m_cells[i+offsets[n]];
+      if (q.load(memory_order_relaxed) & revealed_bit) continue;
+      if (!(q.fetch_or(revealed_bit,memory_order_relaxed) & revealed_bit))
+	work.push_back(i+offsets[n]);
+    }
+  }
+  m_to_go -= revealed;
+}
+
+
+void SharedLake::check_pos(int row, int col) const
+{
+  if (row < 0 || row >= m_rows || col < 0 || col >= m_cols)
+    throw out_of_range("Position outside playing field");
+}